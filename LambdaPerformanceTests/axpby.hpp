@@ -44,6 +44,7 @@
 
 #include <Kokkos_Core.hpp>
 #include <cmath>
+#include <counter_rng.hpp>
 
 struct AXPBY {
     using view_t = Kokkos::View<double*>;
@@ -52,8 +53,8 @@ struct AXPBY {
 
     AXPBY(int N_)
         : N(N_), x(view_t("X", N)), y(view_t("Y", N)), z(view_t("Z", N)) {
-        Kokkos::deep_copy(x, 1);
-        Kokkos::deep_copy(y, 2);
+        fill_counter_random(x, 5374857, 0., 100.);
+        fill_counter_random(y, 5374858, 0., 100.);
     }
 
     KOKKOS_FUNCTION
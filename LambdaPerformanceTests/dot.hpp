@@ -43,8 +43,8 @@
 */
 
 #include <Kokkos_Core.hpp>
-#include <Kokkos_Random.hpp>
 #include <cmath>
+#include <counter_rng.hpp>
 
 struct DOT {
     using view_t = Kokkos::View<double*>;
@@ -54,13 +54,11 @@ struct DOT {
     bool fence_all;
     DOT(int N_, bool fence_all_)
         : N(N_), x(view_t("X", N)), y(view_t("Y", N)), fence_all(fence_all_) {
-        Kokkos::deep_copy(x, 1);
-        Kokkos::deep_copy(y, 2);
-
-        // Filling with random digits fails at runtime for the N=33554432
-        // Kokkos::Random_XorShift64_Pool<> rand_pool64(5374857);
-        // Kokkos::fill_random(x,rand_pool64,100);
-        // Kokkos::fill_random(y,rand_pool64,100);
+        // The counter-based fill keeps no per-thread generator state, so it
+        // also works at N=33554432 where Kokkos::fill_random with a
+        // Random_XorShift64_Pool failed at runtime.
+        fill_counter_random(x, 5374857, 0., 100.);
+        fill_counter_random(y, 5374858, 0., 100.);
     }
 
     KOKKOS_FUNCTION
@@ -44,6 +44,7 @@
 
 #include <Kokkos_Core.hpp>
 #include <cmath>
+#include <multi_reduction.hpp>
 #include <reduction.hpp>
 
 int main(int argc, char *argv[]) {
@@ -52,8 +53,18 @@ int main(int argc, char *argv[]) {
     int64_t N = argc > 1 ? atoi(argv[1]) : 10000;
     int R = argc > 2 ? atoi(argv[2]) : 10;
 
-    Reduction red(N);
-    red.run_test(R);
+    // --stats: sum, min, max and their locations over N * N values, fused
+    // against separate passes.
+    if (argc > 3 && strcmp(argv[3], "--stats") == 0) {
+      MultiReduction stats(N * N);
+      stats.run_test(R);
+    } else {
+      // The tuned launch is loaded from the cache on every run; --tune
+      // searches for it when this N is not cached yet.
+      Reduction red(N);
+      red.tune_launch(R, argc > 3 && strcmp(argv[3], "--tune") == 0);
+      red.run_test(R);
+    }
 
   }
   Kokkos::finalize();
@@ -0,0 +1,295 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef MULTI_REDUCTION_HPP
+#define MULTI_REDUCTION_HPP
+
+#include <Kokkos_Core.hpp>
+#include <cstdio>
+#include <omp.h>
+
+#include <counter_rng.hpp>
+#include <launch_tuner.hpp>
+
+// Sum, minimum, maximum and the first index of each extreme of an array,
+// gathered in one sweep.
+struct Stats {
+  double sum, min_val, max_val;
+  int64_t min_loc, max_loc;
+};
+
+#pragma omp declare target
+KOKKOS_INLINE_FUNCTION
+Stats stats_identity() {
+  Stats s;
+  s.sum = 0;
+  s.min_val = Kokkos::reduction_identity<double>::min();
+  s.max_val = Kokkos::reduction_identity<double>::max();
+  s.min_loc = Kokkos::reduction_identity<int64_t>::min();
+  s.max_loc = Kokkos::reduction_identity<int64_t>::min();
+  return s;
+}
+
+// Combine two partial results. Ties keep the smaller index, so the
+// locations do not depend on how the range was split. Templated on the
+// reference types for the volatile join older Kokkos versions call.
+template <class Dst, class Src>
+KOKKOS_INLINE_FUNCTION void stats_join(Dst &dst, const Src &src) {
+  dst.sum += src.sum;
+  if (src.min_val < dst.min_val ||
+      (src.min_val == dst.min_val && src.min_loc < dst.min_loc)) {
+    dst.min_val = src.min_val;
+    dst.min_loc = src.min_loc;
+  }
+  if (src.max_val > dst.max_val ||
+      (src.max_val == dst.max_val && src.max_loc < dst.max_loc)) {
+    dst.max_val = src.max_val;
+    dst.max_loc = src.max_loc;
+  }
+}
+
+KOKKOS_INLINE_FUNCTION
+void stats_add(Stats &s, double v, int64_t i) {
+  Stats one;
+  one.sum = v;
+  one.min_val = one.max_val = v;
+  one.min_loc = one.max_loc = i;
+  stats_join(s, one);
+}
+#pragma omp end declare target
+
+#pragma omp declare reduction(stats:Stats : stats_join(omp_out, omp_in))     \
+    initializer(omp_priv = stats_identity())
+
+// Kokkos reducer for Stats, usable with parallel_reduce over any policy
+// like the built-in MinMaxLoc.
+template <class Space = Kokkos::HostSpace> struct StatsReducer {
+public:
+  using reducer = StatsReducer;
+  using value_type = Stats;
+  using result_view_type =
+      Kokkos::View<value_type, Space, Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+
+private:
+  result_view_type value;
+
+public:
+  KOKKOS_INLINE_FUNCTION
+  StatsReducer(value_type &value_) : value(&value_) {}
+
+  KOKKOS_INLINE_FUNCTION
+  void join(value_type &dst, const value_type &src) const {
+    stats_join(dst, src);
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  void join(volatile value_type &dst, const volatile value_type &src) const {
+    stats_join(dst, src);
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  void init(value_type &v) const { v = stats_identity(); }
+
+  KOKKOS_INLINE_FUNCTION
+  value_type &reference() const { return *value.data(); }
+
+  KOKKOS_INLINE_FUNCTION
+  result_view_type view() const { return value; }
+
+  KOKKOS_INLINE_FUNCTION
+  bool references_scalar() const { return true; }
+};
+
+// Fused against one pass per statistic: sum, min, max, and the first index
+// holding the min and the max, each found by a min reduction over the
+// indices where the value equals the extreme. The entries are integers, so
+// every sum is exact and all four variants have to agree bit for bit.
+struct MultiReduction {
+  using ExecSpace = Kokkos::DefaultExecutionSpace;
+  using view_t = Kokkos::View<double *, ExecSpace>;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  int64_t n;
+  view_t a;
+
+  MultiReduction(int64_t n_)
+      : n(n_), a(Kokkos::view_alloc(Kokkos::WithoutInitializing, "stats::a"),
+                 n_) {
+    fill_counter_random(a, 5374857, -(int64_t(1) << 20), int64_t(1) << 20);
+    Kokkos::fence();
+  }
+
+  Stats kk_fused() {
+    view_t a_ = a;
+    Stats s;
+    Kokkos::parallel_reduce(
+        "stats_fused", policy_t(0, n),
+        KOKKOS_LAMBDA(const int64_t i, Stats &update) {
+          stats_add(update, a_(i), i);
+        },
+        StatsReducer<>(s));
+    return s;
+  }
+
+  Stats kk_separate() {
+    view_t a_ = a;
+    Stats s;
+    Kokkos::parallel_reduce(
+        "stats_sum", policy_t(0, n),
+        KOKKOS_LAMBDA(const int64_t i, double &update) { update += a_(i); },
+        s.sum);
+    Kokkos::parallel_reduce(
+        "stats_min", policy_t(0, n),
+        KOKKOS_LAMBDA(const int64_t i, double &update) {
+          if (a_(i) < update)
+            update = a_(i);
+        },
+        Kokkos::Min<double>(s.min_val));
+    Kokkos::parallel_reduce(
+        "stats_max", policy_t(0, n),
+        KOKKOS_LAMBDA(const int64_t i, double &update) {
+          if (a_(i) > update)
+            update = a_(i);
+        },
+        Kokkos::Max<double>(s.max_val));
+    const double min_val = s.min_val, max_val = s.max_val;
+    Kokkos::parallel_reduce(
+        "stats_min_loc", policy_t(0, n),
+        KOKKOS_LAMBDA(const int64_t i, int64_t &update) {
+          if (a_(i) == min_val && i < update)
+            update = i;
+        },
+        Kokkos::Min<int64_t>(s.min_loc));
+    Kokkos::parallel_reduce(
+        "stats_max_loc", policy_t(0, n),
+        KOKKOS_LAMBDA(const int64_t i, int64_t &update) {
+          if (a_(i) == max_val && i < update)
+            update = i;
+        },
+        Kokkos::Min<int64_t>(s.max_loc));
+    return s;
+  }
+
+  Stats ompt_fused() {
+    const double *ap = a.data();
+    const int64_t n_ = n;
+    Stats s = stats_identity();
+#pragma omp target teams distribute parallel for is_device_ptr(ap)           \
+    reduction(stats : s)
+    for (int64_t i = 0; i < n_; ++i)
+      stats_add(s, ap[i], i);
+    return s;
+  }
+
+  Stats ompt_separate() {
+    const double *ap = a.data();
+    const int64_t n_ = n;
+    double sum = 0;
+    double min_val = Kokkos::reduction_identity<double>::min();
+    double max_val = Kokkos::reduction_identity<double>::max();
+    int64_t min_loc = Kokkos::reduction_identity<int64_t>::min();
+    int64_t max_loc = Kokkos::reduction_identity<int64_t>::min();
+#pragma omp target teams distribute parallel for is_device_ptr(ap)           \
+    reduction(+ : sum)
+    for (int64_t i = 0; i < n_; ++i)
+      sum += ap[i];
+#pragma omp target teams distribute parallel for is_device_ptr(ap)           \
+    reduction(min : min_val)
+    for (int64_t i = 0; i < n_; ++i)
+      min_val = ap[i] < min_val ? ap[i] : min_val;
+#pragma omp target teams distribute parallel for is_device_ptr(ap)           \
+    reduction(max : max_val)
+    for (int64_t i = 0; i < n_; ++i)
+      max_val = ap[i] > max_val ? ap[i] : max_val;
+#pragma omp target teams distribute parallel for is_device_ptr(ap)           \
+    reduction(min : min_loc)
+    for (int64_t i = 0; i < n_; ++i)
+      if (ap[i] == min_val && i < min_loc)
+        min_loc = i;
+#pragma omp target teams distribute parallel for is_device_ptr(ap)           \
+    reduction(min : max_loc)
+    for (int64_t i = 0; i < n_; ++i)
+      if (ap[i] == max_val && i < max_loc)
+        max_loc = i;
+    Stats s = {sum, min_val, max_val, min_loc, max_loc};
+    return s;
+  }
+
+  static bool same(const Stats &a, const Stats &b) {
+    return a.sum == b.sum && a.min_val == b.min_val &&
+           a.max_val == b.max_val && a.min_loc == b.min_loc &&
+           a.max_loc == b.max_loc;
+  }
+
+  void run_test(int R) {
+    const char *names[2] = {"OMPT", "KK"};
+    Stats ref = stats_identity();
+    double t_fused[2], t_separate[2];
+    bool ok[2];
+    for (int v = 1; v >= 0; --v) {
+      Stats fused, separate;
+      if (v == 0) {
+        t_fused[v] = time_kernel([&]() { fused = ompt_fused(); }, R);
+        t_separate[v] = time_kernel([&]() { separate = ompt_separate(); }, R);
+      } else {
+        t_fused[v] = time_kernel([&]() { fused = kk_fused(); }, R);
+        t_separate[v] = time_kernel([&]() { separate = kk_separate(); }, R);
+        ref = fused;
+      }
+      ok[v] = same(fused, ref) && same(separate, ref);
+    }
+
+    printf("Stats of %li values: sum %.17g, min %g at %li, max %g at %li\n",
+           n, ref.sum, ref.min_val, ref.min_loc, ref.max_val, ref.max_loc);
+    const double bytes = 1. * n * sizeof(double);
+    for (int v = 0; v < 2; ++v)
+      printf("%s: fused %e s %lf GB/s, 5 separate passes %e s %lf GB/s, "
+             "speedup %.2lf%s\n",
+             names[v], t_fused[v], 1e-9 * bytes / t_fused[v], t_separate[v],
+             5e-9 * bytes / t_separate[v], t_separate[v] / t_fused[v],
+             ok[v] ? "" : " (results differ from KK fused)");
+  }
+};
+
+#endif
@@ -46,6 +46,8 @@
 #include <cmath>
 #include <string.h>
 
+#include <launch_tuner.hpp>
+
 #define nT 32
 
 struct Reduction {
@@ -62,6 +64,11 @@ struct Reduction {
   h_view_t h_vector;
   view_t vector;
 
+  // Threads per team of the KK scalar reduction and of both OMPT
+  // reductions, nT unless tune_launch picked others. The OMPT scratch
+  // keeps a stride of nT per team.
+  int nT_kk = nT, nT_ompt = nT;
+
   Reduction(int64_t N_)
       : N(N_), h_vector(h_view_t("h_vector", N_)), vector(view_t("vector", N_)),
         scalar(0) {
@@ -99,12 +106,13 @@ struct Reduction {
     }
 
     scalar = 0;
+    const int nt = nT_ompt;
     Kokkos::Timer timer;
 
     for (int r = 0; r < R; ++r) {
-#pragma omp target teams distribute reduction(+ : scalar) thread_limit(nT)
+#pragma omp target teams distribute reduction(+ : scalar) thread_limit(nt)
       for (int i = 0; i < N; ++i) {
-#pragma omp parallel for reduction(+ : scalar) num_threads(nT)
+#pragma omp parallel for reduction(+ : scalar) num_threads(nt)
         for (int j = 0; j < N; ++j) {
           scalar += i + 1;
         } // end j
@@ -118,16 +126,17 @@ struct Reduction {
     int64_t *vp = h_vector.data();
     int64_t *scratch_ = scratch;
     int N_ = N;
+    const int nt = nT_ompt;
 
     for (int64_t i = 0; i < N_; ++i)
       vp[i] = 0;
 
       // warmup
-#pragma omp target teams distribute thread_limit(nT) map(tofrom                \
+#pragma omp target teams distribute thread_limit(nt) map(tofrom                \
                                                          : vp [0:N])           \
     is_device_ptr(scratch_)
     for (int64_t i = 0; i < N_; ++i) {
-#pragma omp parallel num_threads(nT)
+#pragma omp parallel num_threads(nt)
       {
         int64_t *my_scratch = scratch_ + (omp_get_team_num() * nT);
 #pragma omp single
@@ -148,11 +157,11 @@ struct Reduction {
     Kokkos::Timer timer;
 
     for (int r = 0; r < R; ++r) {
-#pragma omp target teams distribute thread_limit(nT) map(tofrom                \
+#pragma omp target teams distribute thread_limit(nt) map(tofrom                \
                                                          : vp [0:N])           \
     is_device_ptr(scratch_)
       for (int64_t i = 0; i < N_; ++i) {
-#pragma omp parallel num_threads(nT)
+#pragma omp parallel num_threads(nt)
         {
           int64_t *my_scratch = scratch_ + (omp_get_team_num() * nT);
 #pragma omp single
@@ -185,7 +194,7 @@ struct Reduction {
 
     int64_t N_ = N;
     int64_t scalar_ = 0;
-    team_policy policy(N_, nT);
+    team_policy policy(N_, nT_kk);
     view_t vector_ = vector;
 
     // warmup
@@ -288,6 +297,37 @@ struct Reduction {
     correctness("KK", R);
   }
 
+  // Pick the team size of the KK scalar reduction and the OMPT thread count
+  // for this N from the tuner cache. On a miss, time every power of two if
+  // search is set, else keep nT. Both kernels run one team per row, so
+  // there is no league to sweep.
+  void tune_launch(int R, bool search) {
+    LaunchTuner tuner(search);
+    char shape[64];
+    snprintf(shape, sizeof(shape), "%li", N);
+    std::vector<LaunchParams> kk, ompt;
+    for (int ts : launch_pow2(1, launch_thread_cap()))
+      kk.push_back({0, ts, 1, 0});
+    for (int ts : launch_ompt_threads())
+      ompt.push_back({0, ts, 1, 0});
+
+    nT_kk = tuner
+                .tune("reduction", shape, kokkos_backend_name().c_str(),
+                      {0, nT_kk, 1, 0}, kk,
+                      [&](const LaunchParams &p) {
+                        nT_kk = p.team_size;
+                        return run_kk_scalar_redn(R);
+                      })
+                .team_size;
+    nT_ompt = tuner
+                  .tune("reduction", shape, "OMPT", {0, nT_ompt, 1, 0}, ompt,
+                        [&](const LaunchParams &p) {
+                          nT_ompt = p.team_size;
+                          return run_ompt_scalar_redn(R);
+                        })
+                  .team_size;
+  }
+
   void run_test(int R) {
     run_ompt_reduction(R);
     run_kokkos_reduction(R);
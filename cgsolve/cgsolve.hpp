@@ -43,6 +43,23 @@
 */
 
 #include <generate_matrix.hpp>
+#include <symmetric_matrix.hpp>
+#include <synthetic_matrix.hpp>
+#include <interleaved_matrix.hpp>
+#include <matrix_analysis.hpp>
+#include <crs_file.hpp>
+#include <fe_assembly.hpp>
+#include <coo_builder.hpp>
+#include <matrix_market.hpp>
+#include <reorder.hpp>
+#include <spgemm.hpp>
+#include <transpose.hpp>
+
+#include <launch_tuner.hpp>
+
+// Number of doubles of x a team of spmv_scratch_ompt can stage. The array
+// is declared in the teams region, so it is placed in team-shared memory.
+#define SPMV_SCRATCH_WINDOW 4096
 
 struct cgsolve {
 
@@ -51,43 +68,171 @@ struct cgsolve {
   Kokkos::View<double *> y, x;
   CrsMatrix<Kokkos::DefaultExecutionSpace::memory_space> A;
 
-  cgsolve(int N_, int max_iter_in, double tolerance_in)
-      : N(N_), max_iter(max_iter_in), tolerance(tolerance_in) {
-    CrsMatrix<Kokkos::HostSpace> h_A = Impl::generate_miniFE_matrix(N);
-    Kokkos::View<double *, Kokkos::HostSpace> h_x =
-        Impl::generate_miniFE_vector(N);
+  // Half-storage mode: only the upper triangle lives in device memory and
+  // the full A is never allocated there.
+  bool symmetric;
+  bool sym_atomic_kk = true, sym_atomic_ompt = true;
+  SymCrsMatrix<Kokkos::DefaultExecutionSpace::memory_space> A_sym;
+
+  // Per-thread carry-out of the merge-path SpMV, grown on demand.
+  Kokkos::View<int64_t *> merge_carry_row;
+  Kokkos::View<double *> merge_carry_val;
+
+  // File holding the SpMV format decisions of run_auto_test.
+  const char *spmv_cache_path = "spmv_format.cache";
+
+  // Launch of spmv / spmv_ompt when none is given, replaced by the tuned
+  // one in tune_spmv_launch.
+  const char *launch_cache_path = "launch_params.cache";
+  LaunchParams spmv_launch_kk = default_spmv_params();
+  LaunchParams spmv_launch_ompt = {0, 0, 1, 32};
+
+  // Keeps a matrix loaded from a CSR file mapped while A uses it in place.
+  std::shared_ptr<void> matrix_mapping;
+
+  // matrix_file, if given, is a CSR file to load the matrix from; it is
+  // (re)written when it does not hold the matrix for N. mtx_file replaces
+  // the miniFE problem by A x = A * ones for a Matrix Market matrix A.
+  cgsolve(int N_, int max_iter_in, double tolerance_in,
+          bool symmetric_in = false, const char *matrix_file = nullptr,
+          const char *mtx_file = nullptr)
+      : N(N_), max_iter(max_iter_in), tolerance(tolerance_in),
+        symmetric(symmetric_in) {
+    using MemSpace = Kokkos::DefaultExecutionSpace::memory_space;
+    if (mtx_file != nullptr) {
+      CrsMatrix<Kokkos::HostSpace> h_A;
+      if (!Impl::read_matrix_market(mtx_file, h_A) ||
+          h_A.num_rows() != h_A.num_cols())
+        Kokkos::abort("cgsolve: --mtx needs a square Matrix Market matrix");
+
+      // Right hand side A * ones, so the exact solution is all ones.
+      Kokkos::View<double *, Kokkos::HostSpace> h_b("X", h_A.num_rows());
+      Kokkos::parallel_for(
+          "ROW_SUMS",
+          Kokkos::RangePolicy<Kokkos::DefaultHostExecutionSpace>(
+              0, h_A.num_rows()),
+          [=](const int64_t row) {
+            double sum = 0;
+            for (int64_t i = h_A.row_ptr(row); i < h_A.row_ptr(row + 1); ++i)
+              sum += h_A.values(i);
+            h_b(row) = sum;
+          });
+      x = Kokkos::create_mirror_view_and_copy(MemSpace(), h_b);
+      y = Kokkos::View<double *>("Y", x.extent(0));
+
+      if (symmetric)
+        set_symmetric_matrix(h_A);
+      else
+        A = CrsMatrix<MemSpace>(
+            Kokkos::create_mirror_view_and_copy(MemSpace(), h_A.row_ptr),
+            Kokkos::create_mirror_view_and_copy(MemSpace(), h_A.col_idx),
+            Kokkos::create_mirror_view_and_copy(MemSpace(), h_A.values),
+            h_A.num_cols());
+      return;
+    }
+
+    x = Impl::generate_miniFE_vector<MemSpace>(N);
+    y = Kokkos::View<double *>("Y", x.extent(0));
 
-    Kokkos::View<int64_t *> row_ptr("row_ptr", h_A.row_ptr.extent(0));
-    Kokkos::View<int64_t *> col_idx("col_idx", h_A.col_idx.extent(0));
-    Kokkos::View<double *> values("values", h_A.values.extent(0));
-    A = CrsMatrix<Kokkos::DefaultExecutionSpace::memory_space>(
-        row_ptr, col_idx, values, h_A.num_cols());
-    x = Kokkos::View<double *>("X", h_x.extent(0));
-    y = Kokkos::View<double *>("Y", h_x.extent(0));
+    if (symmetric) {
+      // Build on the host so the full matrix never occupies device memory.
+      set_symmetric_matrix(miniFE_matrix<Kokkos::HostSpace>(matrix_file));
+      return;
+    }
 
-    Kokkos::deep_copy(x, h_x);
-    Kokkos::deep_copy(A.row_ptr, h_A.row_ptr);
-    Kokkos::deep_copy(A.col_idx, h_A.col_idx);
-    Kokkos::deep_copy(A.values, h_A.values);
+    A = miniFE_matrix<MemSpace>(matrix_file);
   }
 
-  template <class YType, class AType, class XType>
-  void spmv(YType y, AType A, XType x) {
+  // Keep only the upper triangle of h_A, in device memory.
+  void set_symmetric_matrix(const CrsMatrix<Kokkos::HostSpace> &h_A) {
+    SymCrsMatrix<Kokkos::HostSpace> h_A_sym =
+        Impl::extract_upper_triangle(h_A);
+
+    Kokkos::View<int64_t *> row_ptr("sym_row_ptr", h_A_sym.row_ptr.extent(0));
+    Kokkos::View<int64_t *> col_idx("sym_col_idx", h_A_sym.col_idx.extent(0));
+    Kokkos::View<double *> values("sym_values", h_A_sym.values.extent(0));
+    A_sym = SymCrsMatrix<Kokkos::DefaultExecutionSpace::memory_space>(
+        row_ptr, col_idx, values, h_A_sym.num_cols(), h_A_sym.block_size);
+
+    Kokkos::deep_copy(A_sym.row_ptr, h_A_sym.row_ptr);
+    Kokkos::deep_copy(A_sym.col_idx, h_A_sym.col_idx);
+    Kokkos::deep_copy(A_sym.values, h_A_sym.values);
+  }
+
+  // The miniFE matrix for N in MemSpace, mapped from matrix_file when it
+  // holds that matrix. Host spaces then use the mapping without a copy.
+  template <class MemSpace>
+  CrsMatrix<MemSpace> miniFE_matrix(const char *matrix_file) {
+    Kokkos::Timer timer;
+    if (matrix_file != nullptr) {
+      MappedCrsMatrix mapped;
+      const int64_t nrows = int64_t(N + 1) * (N + 1) * (N + 1);
+      if (Impl::load_crs_file(matrix_file, mapped)) {
+        if (mapped.matrix.num_rows() == nrows) {
+          CrsMatrix<MemSpace> A_file(
+              Kokkos::create_mirror_view_and_copy(MemSpace(),
+                                                  mapped.matrix.row_ptr),
+              Kokkos::create_mirror_view_and_copy(MemSpace(),
+                                                  mapped.matrix.col_idx),
+              Kokkos::create_mirror_view_and_copy(MemSpace(),
+                                                  mapped.matrix.values),
+              mapped.matrix.num_cols());
+          matrix_mapping = mapped.mapping;
+          printf("Matrix: loaded %s in %e s\n", matrix_file,
+                 timer.seconds());
+          return A_file;
+        }
+        printf("Matrix: %s has %li rows, expected %li\n", matrix_file,
+               mapped.matrix.num_rows(), nrows);
+      }
+    }
+
+    auto A_gen = Impl::generate_miniFE_matrix<MemSpace>(N);
+    Kokkos::fence();
+    if (matrix_file != nullptr) {
+      printf("Matrix: generated in %e s\n", timer.seconds());
+      timer.reset();
+      if (Impl::write_crs_file(matrix_file, A_gen))
+        printf("Matrix: wrote %s in %e s\n", matrix_file, timer.seconds());
+    }
+    return A_gen;
+  }
+
+  // Launch shape of the row-based kernels for the enabled backend.
+  static void default_spmv_launch(int &rows_per_team, int &team_size) {
 #ifdef KOKKOS_ENABLE_CUDA
-    int rows_per_team = 16;
-    int team_size = 16;
+    rows_per_team = 16;
+    team_size = 16;
 #elif defined(KOKKOS_ENABLE_OPENMPTARGET)
-    int rows_per_team = 32;
-    int team_size = 32;
+    rows_per_team = 32;
+    team_size = 32;
 #else
-    int rows_per_team = 512;
-    int team_size = 1;
+    rows_per_team = 512;
+    team_size = 1;
 #endif
+  }
+
+  static LaunchParams default_spmv_params() {
+    LaunchParams p;
+    default_spmv_launch(p.rows_per_team, p.team_size);
+    p.vector_length = 8;
+    return p;
+  }
+
+  template <class YType, class AType, class XType>
+  void spmv(YType y, AType A, XType x) {
+    spmv(y, A, x, spmv_launch_kk.rows_per_team, spmv_launch_kk.team_size,
+         spmv_launch_kk.vector_length);
+  }
+
+  template <class YType, class AType, class XType>
+  void spmv(YType y, AType A, XType x, int rows_per_team, int team_size,
+            int vector_length = 8) {
     int64_t nrows = y.extent(0);
     Kokkos::parallel_for(
         "SPMV",
         Kokkos::TeamPolicy<>((nrows + rows_per_team - 1) / rows_per_team,
-                             team_size, 8),
+                             team_size, vector_length),
         KOKKOS_LAMBDA(const Kokkos::TeamPolicy<>::member_type &team) {
           const int64_t first_row = team.league_rank() * rows_per_team;
           const int64_t last_row = first_row + rows_per_team < nrows
@@ -114,8 +259,195 @@ struct cgsolve {
 
   template <class YType, class AType, class XType>
   void spmv_ompt(YType y, AType A, XType x) {
+    // A team size of 0 leaves the number of threads to the runtime.
+    spmv_ompt(y, A, x, spmv_launch_ompt.rows_per_team,
+              spmv_launch_ompt.team_size);
+  }
+
+  // Load the launch of the row-based SpMV kernels for the shape of A from
+  // launch_cache_path. On a miss, tune it if search is set, else keep the
+  // defaults. The league follows from rows_per_team.
+  void tune_spmv_launch(int R, bool search) {
+    if (symmetric) {
+      if (search)
+        printf("SPMV launch tuning needs the full matrix, run without --sym\n");
+      return;
+    }
+    LaunchTuner tuner(search, launch_cache_path);
+    char shape[64];
+    snprintf(shape, sizeof(shape), "%lix%li", A.num_rows(), A.nnz());
+    Kokkos::View<double *> y_tune("Y_tune", y.extent(0));
+    const int cap = launch_thread_cap();
+    std::vector<LaunchParams> kk, ompt;
+    for (int rows : launch_pow2(4, 512)) {
+      for (int ts : launch_pow2(1, cap))
+        for (int vl : launch_pow2(1, launch_vector_cap()))
+          if (ts * vl <= cap && ts <= rows)
+            kk.push_back({0, ts, vl, rows});
+      ompt.push_back({0, 0, 1, rows});
+      for (int ts : launch_ompt_threads())
+        ompt.push_back({0, ts, 1, rows});
+    }
+
+    spmv_launch_kk = tuner.tune(
+        "spmv", shape, kokkos_backend_name().c_str(), spmv_launch_kk, kk,
+        [&](const LaunchParams &p) {
+          return time_kernel(
+              [&]() {
+                spmv(y_tune, A, x, p.rows_per_team, p.team_size,
+                     p.vector_length);
+              },
+              R);
+        });
+    spmv_launch_ompt = tuner.tune(
+        "spmv", shape, "OMPT", spmv_launch_ompt, ompt,
+        [&](const LaunchParams &p) {
+          return time_kernel(
+              [&]() {
+                spmv_ompt(y_tune, A, x, p.rows_per_team, p.team_size);
+              },
+              R);
+        });
+  }
+
+  template <class YType, class AType, class XType>
+  void spmv_ompt(YType y, AType A, XType x, int rows_per_team,
+                 int team_size) {
+    int64_t nrows = y.extent(0);
+
+    auto row_ptr = A.row_ptr.data();
+    auto values = A.values.data();
+    auto col_idx = A.col_idx.data();
+    auto xp = x.data();
+    auto yp = y.data();
+
+    int64_t n = (nrows + rows_per_team - 1) / rows_per_team;
+#pragma omp target teams distribute is_device_ptr(row_ptr, values, col_idx,    \
+                                                  xp, yp)
+    for (int64_t i = 0; i < n; ++i) {
+      const int nthreads = team_size > 0 ? team_size : omp_get_max_threads();
+#pragma omp parallel num_threads(nthreads)
+      {
+        const int64_t first_row = i * rows_per_team;
+        const int64_t last_row = first_row + rows_per_team < nrows
+                                     ? first_row + rows_per_team
+                                     : nrows;
+
+#pragma omp for
+        for (int64_t row = first_row; row < last_row; ++row) {
+          const int64_t row_start = row_ptr[row];
+          const int64_t row_length = row_ptr[row + 1] - row_start;
+
+          double y_row = 0.;
+#pragma omp simd reduction(+ : y_row)
+          for (int64_t i = 0; i < row_length; ++i) {
+            y_row += values[i + row_start] * xp[col_idx[i + row_start]];
+          }
+          yp[row] = y_row;
+        }
+      }
+    }
+  }
+
+  // Symmetric SpMV on the upper triangle: y = U x + (U - D)^T x.
+  // Every off-diagonal entry also scatters into y(col), which other teams
+  // may be updating at the same time, so y is zeroed first and all writes
+  // are atomic.
+  template <class YType, class AType, class XType>
+  void spmv_sym_atomic(YType y, AType A, XType x) {
+    int rows_per_team, team_size;
+    default_spmv_launch(rows_per_team, team_size);
+    int64_t nrows = y.extent(0);
+    Kokkos::deep_copy(y, 0.0);
+    Kokkos::parallel_for(
+        "SPMV_SYM_ATOMIC",
+        Kokkos::TeamPolicy<>((nrows + rows_per_team - 1) / rows_per_team,
+                             team_size, 8),
+        KOKKOS_LAMBDA(const Kokkos::TeamPolicy<>::member_type &team) {
+          const int64_t first_row = team.league_rank() * rows_per_team;
+          const int64_t last_row = first_row + rows_per_team < nrows
+                                       ? first_row + rows_per_team
+                                       : nrows;
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, first_row, last_row),
+              [&](const int64_t row) {
+                const int64_t row_start = A.row_ptr(row);
+                const int64_t row_length = A.row_ptr(row + 1) - row_start;
+                const double x_row = x(row);
+
+                double y_row;
+                Kokkos::parallel_reduce(
+                    Kokkos::ThreadVectorRange(team, row_length),
+                    [=](const int64_t i, double &sum) {
+                      const int64_t col = A.col_idx(i + row_start);
+                      const double val = A.values(i + row_start);
+                      sum += val * x(col);
+                      if (col != row)
+                        Kokkos::atomic_add(&y(col), val * x_row);
+                    },
+                    y_row);
+                Kokkos::single(Kokkos::PerThread(team),
+                               [&]() { Kokkos::atomic_add(&y(row), y_row); });
+              });
+        });
+  }
+
+  // Symmetric SpMV with a two-color block schedule. Blocks are
+  // A.block_size rows (>= upper bandwidth), so block k only writes rows of
+  // blocks k and k+1: all even blocks can run concurrently, then all odd
+  // blocks, without atomics. Rows inside a block are processed in order by a
+  // single thread; the columns of one row are distinct so the vector lanes
+  // can scatter freely.
+  template <class YType, class AType, class XType>
+  void spmv_sym_colored(YType y, AType A, XType x) {
+    int64_t nrows = y.extent(0);
+    int64_t block_size = A.block_size;
+    int64_t nblocks = (nrows + block_size - 1) / block_size;
+    Kokkos::deep_copy(y, 0.0);
+    for (int color = 0; color < 2; ++color) {
+      Kokkos::parallel_for(
+          "SPMV_SYM_COLORED",
+          Kokkos::TeamPolicy<>((nblocks - color + 1) / 2, 1, 8),
+          KOKKOS_LAMBDA(const Kokkos::TeamPolicy<>::member_type &team) {
+            const int64_t block = 2 * team.league_rank() + color;
+            const int64_t first_row = block * block_size;
+            const int64_t last_row = first_row + block_size < nrows
+                                         ? first_row + block_size
+                                         : nrows;
+            for (int64_t row = first_row; row < last_row; ++row) {
+              const int64_t row_start = A.row_ptr(row);
+              const int64_t row_length = A.row_ptr(row + 1) - row_start;
+              const double x_row = x(row);
+
+              double y_row;
+              Kokkos::parallel_reduce(
+                  Kokkos::ThreadVectorRange(team, row_length),
+                  [=](const int64_t i, double &sum) {
+                    const int64_t col = A.col_idx(i + row_start);
+                    const double val = A.values(i + row_start);
+                    sum += val * x(col);
+                    if (col != row)
+                      y(col) += val * x_row;
+                  },
+                  y_row);
+              Kokkos::single(Kokkos::PerThread(team),
+                             [&]() { y(row) += y_row; });
+            }
+          });
+    }
+  }
+
+  template <class YType, class MemSpace, class XType>
+  void spmv(YType y, SymCrsMatrix<MemSpace> A, XType x) {
+    if (sym_atomic_kk)
+      spmv_sym_atomic(y, A, x);
+    else
+      spmv_sym_colored(y, A, x);
+  }
+
+  template <class YType, class AType, class XType>
+  void spmv_sym_atomic_ompt(YType y, AType A, XType x) {
     int rows_per_team = 32;
-    int team_size = 32;
     int64_t nrows = y.extent(0);
 
     auto row_ptr = A.row_ptr.data();
@@ -124,6 +456,10 @@ struct cgsolve {
     auto xp = x.data();
     auto yp = y.data();
 
+#pragma omp target teams distribute parallel for is_device_ptr(yp)
+    for (int64_t row = 0; row < nrows; ++row)
+      yp[row] = 0.;
+
     int64_t n = (nrows + rows_per_team - 1) / rows_per_team;
 #pragma omp target teams distribute is_device_ptr(row_ptr, values, col_idx,    \
                                                   xp, yp)
@@ -139,15 +475,548 @@ struct cgsolve {
         for (int64_t row = first_row; row < last_row; ++row) {
           const int64_t row_start = row_ptr[row];
           const int64_t row_length = row_ptr[row + 1] - row_start;
+          const double x_row = xp[row];
 
           double y_row = 0.;
 #pragma omp simd reduction(+ : y_row)
           for (int64_t i = 0; i < row_length; ++i) {
-            y_row += values[i + row_start] * xp[col_idx[i + row_start]];
+            const int64_t col = col_idx[i + row_start];
+            const double val = values[i + row_start];
+            y_row += val * xp[col];
+            if (col != row) {
+#pragma omp atomic update
+              yp[col] += val * x_row;
+            }
+          }
+#pragma omp atomic update
+          yp[row] += y_row;
+        }
+      }
+    }
+  }
+
+  template <class YType, class AType, class XType>
+  void spmv_sym_colored_ompt(YType y, AType A, XType x) {
+    int64_t nrows = y.extent(0);
+    int64_t block_size = A.block_size;
+    int64_t nblocks = (nrows + block_size - 1) / block_size;
+
+    auto row_ptr = A.row_ptr.data();
+    auto values = A.values.data();
+    auto col_idx = A.col_idx.data();
+    auto xp = x.data();
+    auto yp = y.data();
+
+#pragma omp target teams distribute parallel for is_device_ptr(yp)
+    for (int64_t row = 0; row < nrows; ++row)
+      yp[row] = 0.;
+
+    for (int color = 0; color < 2; ++color) {
+      int64_t n = (nblocks - color + 1) / 2;
+#pragma omp target teams distribute parallel for is_device_ptr(                \
+    row_ptr, values, col_idx, xp, yp)
+      for (int64_t b = 0; b < n; ++b) {
+        const int64_t first_row = (2 * b + color) * block_size;
+        const int64_t last_row = first_row + block_size < nrows
+                                     ? first_row + block_size
+                                     : nrows;
+        for (int64_t row = first_row; row < last_row; ++row) {
+          const int64_t row_start = row_ptr[row];
+          const int64_t row_length = row_ptr[row + 1] - row_start;
+          const double x_row = xp[row];
+
+          double y_row = 0.;
+#pragma omp simd reduction(+ : y_row)
+          for (int64_t i = 0; i < row_length; ++i) {
+            const int64_t col = col_idx[i + row_start];
+            const double val = values[i + row_start];
+            y_row += val * xp[col];
+            if (col != row)
+              yp[col] += val * x_row;
+          }
+          yp[row] += y_row;
+        }
+      }
+    }
+  }
+
+  template <class YType, class MemSpace, class XType>
+  void spmv_ompt(YType y, SymCrsMatrix<MemSpace> A, XType x) {
+    if (sym_atomic_ompt)
+      spmv_sym_atomic_ompt(y, A, x);
+    else
+      spmv_sym_colored_ompt(y, A, x);
+  }
+
+  // Locate the point where a diagonal crosses the merge path of the row
+  // end offsets (row_ptr[1..nrows]) and the nonzero indices [0, nnz).
+  // row rows have been completed and nz nonzeros consumed at that point.
+  template <class RowPtrType>
+  KOKKOS_INLINE_FUNCTION static void
+  merge_path_search(const int64_t diagonal, const RowPtrType row_ptr,
+                    const int64_t nrows, const int64_t nnz, int64_t &row,
+                    int64_t &nz) {
+    int64_t lo = diagonal > nnz ? diagonal - nnz : 0;
+    int64_t hi = diagonal < nrows ? diagonal : nrows;
+    while (lo < hi) {
+      const int64_t mid = (lo + hi) / 2;
+      if (row_ptr[mid + 1] <= diagonal - 1 - mid)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    row = lo;
+    nz = diagonal - lo;
+  }
+
+  void resize_merge_carry(int64_t nthreads) {
+    if (int64_t(merge_carry_row.extent(0)) < nthreads) {
+      merge_carry_row = Kokkos::View<int64_t *>("merge_carry_row", nthreads);
+      merge_carry_val = Kokkos::View<double *>("merge_carry_val", nthreads);
+    }
+  }
+
+  // Merge-path SpMV: every thread gets the same number of rows plus
+  // nonzeros, so long rows are split across threads instead of stalling
+  // the team that owns them. Rows completed inside a thread's range are
+  // stored directly; the partial sum of the row a thread stops in is left
+  // as a carry and added by the fix-up kernel.
+  template <class YType, class AType, class XType>
+  void spmv_merge(YType y, AType A, XType x) {
+#if defined(KOKKOS_ENABLE_CUDA) || defined(KOKKOS_ENABLE_OPENMPTARGET)
+    int64_t items_per_thread = 64;
+#else
+    int64_t items_per_thread = 4096;
+#endif
+    int64_t nrows = y.extent(0);
+    int64_t nnz = 0;
+    Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, nrows));
+    int64_t num_items = nrows + nnz;
+    int64_t nthreads = (num_items + items_per_thread - 1) / items_per_thread;
+    resize_merge_carry(nthreads);
+    auto carry_row = merge_carry_row;
+    auto carry_val = merge_carry_val;
+
+    Kokkos::parallel_for(
+        "SPMV_MERGE", nthreads, KOKKOS_LAMBDA(const int64_t t) {
+          const int64_t diagonal = t * items_per_thread;
+          const int64_t diagonal_end = diagonal + items_per_thread < num_items
+                                           ? diagonal + items_per_thread
+                                           : num_items;
+          int64_t row, nz, row_end, nz_end;
+          merge_path_search(diagonal, A.row_ptr, nrows, nnz, row, nz);
+          merge_path_search(diagonal_end, A.row_ptr, nrows, nnz, row_end,
+                            nz_end);
+
+          double sum = 0.;
+          for (; row < row_end; ++row) {
+            for (; nz < A.row_ptr(row + 1); ++nz)
+              sum += A.values(nz) * x(A.col_idx(nz));
+            y(row) = sum;
+            sum = 0.;
+          }
+          for (; nz < nz_end; ++nz)
+            sum += A.values(nz) * x(A.col_idx(nz));
+          carry_row(t) = row_end;
+          carry_val(t) = sum;
+        });
+
+    Kokkos::parallel_for(
+        "SPMV_MERGE_FIXUP", nthreads, KOKKOS_LAMBDA(const int64_t t) {
+          if (carry_row(t) < nrows)
+            Kokkos::atomic_add(&y(carry_row(t)), carry_val(t));
+        });
+  }
+
+  template <class YType, class AType, class XType>
+  void spmv_merge_ompt(YType y, AType A, XType x) {
+    int64_t items_per_thread = 64;
+    int64_t nrows = y.extent(0);
+    int64_t nnz = 0;
+    Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, nrows));
+    int64_t num_items = nrows + nnz;
+    int64_t nthreads = (num_items + items_per_thread - 1) / items_per_thread;
+    resize_merge_carry(nthreads);
+
+    auto row_ptr = A.row_ptr.data();
+    auto values = A.values.data();
+    auto col_idx = A.col_idx.data();
+    auto xp = x.data();
+    auto yp = y.data();
+    auto carry_row = merge_carry_row.data();
+    auto carry_val = merge_carry_val.data();
+
+#pragma omp target teams distribute parallel for is_device_ptr(                \
+    row_ptr, values, col_idx, xp, yp, carry_row, carry_val)
+    for (int64_t t = 0; t < nthreads; ++t) {
+      const int64_t diagonal = t * items_per_thread;
+      const int64_t diagonal_end = diagonal + items_per_thread < num_items
+                                       ? diagonal + items_per_thread
+                                       : num_items;
+      int64_t row, nz, row_end, nz_end;
+      merge_path_search(diagonal, row_ptr, nrows, nnz, row, nz);
+      merge_path_search(diagonal_end, row_ptr, nrows, nnz, row_end, nz_end);
+
+      double sum = 0.;
+      for (; row < row_end; ++row) {
+        for (; nz < row_ptr[row + 1]; ++nz)
+          sum += values[nz] * xp[col_idx[nz]];
+        yp[row] = sum;
+        sum = 0.;
+      }
+      for (; nz < nz_end; ++nz)
+        sum += values[nz] * xp[col_idx[nz]];
+      carry_row[t] = row_end;
+      carry_val[t] = sum;
+    }
+
+#pragma omp target teams distribute parallel for is_device_ptr(                \
+    yp, carry_row, carry_val)
+    for (int64_t t = 0; t < nthreads; ++t) {
+      if (carry_row[t] < nrows) {
+#pragma omp atomic update
+        yp[carry_row[t]] += carry_val[t];
+      }
+    }
+  }
+
+  // SpMV that stages the slice of x touched by a team in team scratch.
+  // A team first reduces the column range of its rows; if that window fits
+  // in scratch_bytes it is copied into scratch once and all gathers read
+  // from there, otherwise the team gathers from x directly. Returns the
+  // number of nonzeros that were served from scratch.
+  template <class YType, class AType, class XType>
+  int64_t spmv_scratch(YType y, AType A, XType x, int rows_per_team,
+                       int scratch_level, size_t scratch_bytes) {
+    using scratch_t =
+        Kokkos::View<double *,
+                     Kokkos::DefaultExecutionSpace::scratch_memory_space,
+                     Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+#ifdef KOKKOS_ENABLE_CUDA
+    int team_size = 16;
+#elif defined(KOKKOS_ENABLE_OPENMPTARGET)
+    int team_size = 32;
+#else
+    int team_size = 1;
+#endif
+    int64_t nrows = y.extent(0);
+    Kokkos::TeamPolicy<> policy((nrows + rows_per_team - 1) / rows_per_team,
+                                team_size, 8);
+    policy = policy.set_scratch_size(scratch_level,
+                                     Kokkos::PerTeam(scratch_bytes));
+
+    int64_t staged = 0;
+    Kokkos::parallel_reduce(
+        "SPMV_SCRATCH", policy,
+        KOKKOS_LAMBDA(const Kokkos::TeamPolicy<>::member_type &team,
+                      int64_t &team_staged) {
+          const int64_t first_row = team.league_rank() * rows_per_team;
+          const int64_t last_row = first_row + rows_per_team < nrows
+                                       ? first_row + rows_per_team
+                                       : nrows;
+          const int64_t nz_begin = A.row_ptr(first_row);
+          const int64_t nz_end = A.row_ptr(last_row);
+
+          Kokkos::MinMaxScalar<int64_t> cols;
+          Kokkos::parallel_reduce(
+              Kokkos::TeamVectorRange(team, nz_begin, nz_end),
+              [&](const int64_t i, Kokkos::MinMaxScalar<int64_t> &lcols) {
+                const int64_t col = A.col_idx(i);
+                if (col < lcols.min_val)
+                  lcols.min_val = col;
+                if (col > lcols.max_val)
+                  lcols.max_val = col;
+              },
+              Kokkos::MinMax<int64_t>(cols));
+
+          const int64_t window =
+              nz_end > nz_begin ? cols.max_val - cols.min_val + 1 : 0;
+          const bool use_scratch =
+              window > 0 && scratch_t::shmem_size(window) <= scratch_bytes;
+
+          scratch_t x_window;
+          int64_t offset = 0;
+          if (use_scratch) {
+            x_window = scratch_t(team.team_scratch(scratch_level), window);
+            offset = cols.min_val;
+            Kokkos::parallel_for(Kokkos::TeamVectorRange(team, window),
+                                 [&](const int64_t i) {
+                                   x_window(i) = x(offset + i);
+                                 });
+            team.team_barrier();
+            Kokkos::single(Kokkos::PerTeam(team), [&]() {
+              team_staged += nz_end - nz_begin;
+            });
+          }
+          const double *xv = use_scratch ? x_window.data() : x.data();
+
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, first_row, last_row),
+              [&](const int64_t row) {
+                const int64_t row_start = A.row_ptr(row);
+                const int64_t row_length = A.row_ptr(row + 1) - row_start;
+
+                double y_row;
+                Kokkos::parallel_reduce(
+                    Kokkos::ThreadVectorRange(team, row_length),
+                    [=](const int64_t i, double &sum) {
+                      sum += A.values(i + row_start) *
+                             xv[A.col_idx(i + row_start) - offset];
+                    },
+                    y_row);
+                y(row) = y_row;
+              });
+        },
+        staged);
+    return staged;
+  }
+
+  template <class YType, class AType, class XType>
+  int64_t spmv_scratch_ompt(YType y, AType A, XType x, int rows_per_team) {
+    int64_t nrows = y.extent(0);
+
+    auto row_ptr = A.row_ptr.data();
+    auto values = A.values.data();
+    auto col_idx = A.col_idx.data();
+    auto xp = x.data();
+    auto yp = y.data();
+
+    int64_t staged = 0;
+    int64_t n = (nrows + rows_per_team - 1) / rows_per_team;
+#pragma omp target teams distribute is_device_ptr(row_ptr, values, col_idx,    \
+                                                  xp, yp) reduction(+ : staged)
+    for (int64_t t = 0; t < n; ++t) {
+      double x_window[SPMV_SCRATCH_WINDOW];
+      const int64_t first_row = t * rows_per_team;
+      const int64_t last_row = first_row + rows_per_team < nrows
+                                   ? first_row + rows_per_team
+                                   : nrows;
+      const int64_t nz_begin = row_ptr[first_row];
+      const int64_t nz_end = row_ptr[last_row];
+      int64_t col_min = INT64_MAX;
+      int64_t col_max = -1;
+
+#pragma omp parallel
+      {
+#pragma omp for reduction(min : col_min) reduction(max : col_max)
+        for (int64_t i = nz_begin; i < nz_end; ++i) {
+          col_min = col_idx[i] < col_min ? col_idx[i] : col_min;
+          col_max = col_idx[i] > col_max ? col_idx[i] : col_max;
+        }
+
+        const int64_t window = col_max >= col_min ? col_max - col_min + 1 : 0;
+        const bool use_scratch = window > 0 && window <= SPMV_SCRATCH_WINDOW;
+        const int64_t offset = use_scratch ? col_min : 0;
+        if (use_scratch) {
+#pragma omp for
+          for (int64_t i = 0; i < window; ++i)
+            x_window[i] = xp[offset + i];
+        }
+        const double *xv = use_scratch ? x_window : xp;
+
+#pragma omp for
+        for (int64_t row = first_row; row < last_row; ++row) {
+          const int64_t row_start = row_ptr[row];
+          const int64_t row_length = row_ptr[row + 1] - row_start;
+
+          double y_row = 0.;
+#pragma omp simd reduction(+ : y_row)
+          for (int64_t i = 0; i < row_length; ++i) {
+            y_row +=
+                values[i + row_start] * xv[col_idx[i + row_start] - offset];
           }
           yp[row] = y_row;
         }
       }
+      if (col_max >= col_min && col_max - col_min + 1 <= SPMV_SCRATCH_WINDOW)
+        staged += nz_end - nz_begin;
+    }
+    return staged;
+  }
+
+  // Same schedule as spmv, but column and value of a nonzero come from one
+  // interleaved entry, so each nonzero is a single memory stream.
+  template <class YType, class AType, class XType>
+  void spmv_interleaved(YType y, AType A, XType x, int rows_per_team,
+                        int team_size) {
+    int64_t nrows = y.extent(0);
+    Kokkos::parallel_for(
+        "SPMV_INTERLEAVED",
+        Kokkos::TeamPolicy<>((nrows + rows_per_team - 1) / rows_per_team,
+                             team_size, 8),
+        KOKKOS_LAMBDA(const Kokkos::TeamPolicy<>::member_type &team) {
+          const int64_t first_row = team.league_rank() * rows_per_team;
+          const int64_t last_row = first_row + rows_per_team < nrows
+                                       ? first_row + rows_per_team
+                                       : nrows;
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, first_row, last_row),
+              [&](const int64_t row) {
+                const int64_t row_start = A.row_ptr(row);
+                const int64_t row_length = A.row_ptr(row + 1) - row_start;
+
+                double y_row;
+                Kokkos::parallel_reduce(
+                    Kokkos::ThreadVectorRange(team, row_length),
+                    [=](const int64_t i, double &sum) {
+                      const auto entry = A.entries(i + row_start);
+                      sum += entry.value() * x(entry.column());
+                    },
+                    y_row);
+                y(row) = y_row;
+              });
+        });
+  }
+
+  template <class YType, class AType, class XType>
+  void spmv_interleaved_ompt(YType y, AType A, XType x, int rows_per_team,
+                             int team_size) {
+    int64_t nrows = y.extent(0);
+
+    auto row_ptr = A.row_ptr.data();
+    auto entries = A.entries.data();
+    auto xp = x.data();
+    auto yp = y.data();
+
+    int64_t n = (nrows + rows_per_team - 1) / rows_per_team;
+#pragma omp target teams distribute is_device_ptr(row_ptr, entries, xp, yp)
+    for (int64_t i = 0; i < n; ++i) {
+      const int nthreads = team_size > 0 ? team_size : omp_get_max_threads();
+#pragma omp parallel num_threads(nthreads)
+      {
+        const int64_t first_row = i * rows_per_team;
+        const int64_t last_row = first_row + rows_per_team < nrows
+                                     ? first_row + rows_per_team
+                                     : nrows;
+
+#pragma omp for
+        for (int64_t row = first_row; row < last_row; ++row) {
+          const int64_t row_start = row_ptr[row];
+          const int64_t row_length = row_ptr[row + 1] - row_start;
+
+          double y_row = 0.;
+#pragma omp simd reduction(+ : y_row)
+          for (int64_t i = 0; i < row_length; ++i) {
+            const auto entry = entries[i + row_start];
+            y_row += entry.value() * xp[entry.column()];
+          }
+          yp[row] = y_row;
+        }
+      }
+    }
+  }
+
+  // y = A^T x without forming A^T: every entry of row `row` scatters
+  // A(row,col)*x(row) into y(col), so y is zeroed first and all writes are
+  // atomic. y has one entry per column of A.
+  template <class YType, class AType, class XType>
+  void spmv_transpose_atomic(YType y, AType A, XType x) {
+    int rows_per_team, team_size;
+    default_spmv_launch(rows_per_team, team_size);
+    int64_t nrows = x.extent(0);
+    Kokkos::deep_copy(y, 0.0);
+    Kokkos::parallel_for(
+        "SPMV_TRANSPOSE_ATOMIC",
+        Kokkos::TeamPolicy<>((nrows + rows_per_team - 1) / rows_per_team,
+                             team_size, 8),
+        KOKKOS_LAMBDA(const Kokkos::TeamPolicy<>::member_type &team) {
+          const int64_t first_row = team.league_rank() * rows_per_team;
+          const int64_t last_row = first_row + rows_per_team < nrows
+                                       ? first_row + rows_per_team
+                                       : nrows;
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, first_row, last_row),
+              [&](const int64_t row) {
+                const int64_t row_start = A.row_ptr(row);
+                const int64_t row_length = A.row_ptr(row + 1) - row_start;
+                const double x_row = x(row);
+                Kokkos::parallel_for(
+                    Kokkos::ThreadVectorRange(team, row_length),
+                    [=](const int64_t i) {
+                      Kokkos::atomic_add(&y(A.col_idx(i + row_start)),
+                                         A.values(i + row_start) * x_row);
+                    });
+              });
+        });
+  }
+
+  template <class YType, class AType, class XType>
+  void spmv_transpose_atomic_ompt(YType y, AType A, XType x) {
+    int rows_per_team = 32;
+    int64_t nrows = x.extent(0);
+    int64_t ncols = y.extent(0);
+
+    auto row_ptr = A.row_ptr.data();
+    auto values = A.values.data();
+    auto col_idx = A.col_idx.data();
+    auto xp = x.data();
+    auto yp = y.data();
+
+#pragma omp target teams distribute parallel for is_device_ptr(yp)
+    for (int64_t col = 0; col < ncols; ++col)
+      yp[col] = 0.;
+
+    int64_t n = (nrows + rows_per_team - 1) / rows_per_team;
+#pragma omp target teams distribute is_device_ptr(row_ptr, values, col_idx,    \
+                                                  xp, yp)
+    for (int64_t i = 0; i < n; ++i) {
+#pragma omp parallel
+      {
+        const int64_t first_row = i * rows_per_team;
+        const int64_t last_row = first_row + rows_per_team < nrows
+                                     ? first_row + rows_per_team
+                                     : nrows;
+
+#pragma omp for
+        for (int64_t row = first_row; row < last_row; ++row) {
+          const int64_t row_start = row_ptr[row];
+          const int64_t row_length = row_ptr[row + 1] - row_start;
+          const double x_row = xp[row];
+#pragma omp simd
+          for (int64_t i = 0; i < row_length; ++i) {
+#pragma omp atomic update
+            yp[col_idx[i + row_start]] += values[i + row_start] * x_row;
+          }
+        }
+      }
+    }
+  }
+
+  // Run the kernel the selector chose for this backend.
+  template <class YType, class MemSpace, class XType>
+  void spmv(YType y, TunedCrsMatrix<MemSpace> A, XType x) {
+    int rows_per_team, team_size;
+    default_spmv_launch(rows_per_team, team_size);
+    switch (A.format_kk) {
+    case SPMV_CSR_MERGE:
+      spmv_merge(y, A.csr, x);
+      break;
+    case SPMV_CSR_SCRATCH:
+      spmv_scratch(y, A.csr, x, 128, 0,
+                   Kokkos::TeamPolicy<>::scratch_size_max(0));
+      break;
+    case SPMV_INTERLEAVED:
+      spmv_interleaved(y, A.interleaved, x, rows_per_team, team_size);
+      break;
+    default:
+      spmv(y, A.csr, x, rows_per_team, team_size);
+    }
+  }
+
+  template <class YType, class MemSpace, class XType>
+  void spmv_ompt(YType y, TunedCrsMatrix<MemSpace> A, XType x) {
+    switch (A.format_ompt) {
+    case SPMV_CSR_MERGE:
+      spmv_merge_ompt(y, A.csr, x);
+      break;
+    case SPMV_CSR_SCRATCH:
+      spmv_scratch_ompt(y, A.csr, x, 128);
+      break;
+    case SPMV_INTERLEAVED:
+      spmv_interleaved_ompt(y, A.interleaved, x, 32, 0);
+      break;
+    default:
+      spmv_ompt(y, A.csr, x);
     }
   }
 
@@ -161,7 +1030,7 @@ struct cgsolve {
   }
 
   template <class YType, class XType> double dot_ompt(YType y, XType x) {
-    double result;
+    double result = 0.;
     int n = y.extent(0);
     auto xp = x.data();
     auto yp = y.data();
@@ -265,6 +1134,7 @@ struct cgsolve {
         if (p_ap_dot < 0) {
           std::cerr << "miniFE::cg_solve ERROR, numerical breakdown!"
                     << std::endl;
+          Kokkos::deep_copy(y, x);
           return num_iters;
         } else
           brkdown_tol = 0.1 * p_ap_dot;
@@ -275,6 +1145,7 @@ struct cgsolve {
       axpby(r, one, r, -alpha, Ap);
       num_iters = k;
     }
+    Kokkos::deep_copy(y, x);
     return num_iters;
   }
 
@@ -336,6 +1207,7 @@ struct cgsolve {
         if (p_ap_dot < 0) {
           std::cerr << "miniFE::cg_solve ERROR, numerical breakdown!"
                     << std::endl;
+          Kokkos::deep_copy(y, x);
           return num_iters;
         } else
           brkdown_tol = 0.1 * p_ap_dot;
@@ -346,6 +1218,7 @@ struct cgsolve {
       axpby_ompt(r, one, r, -alpha, Ap);
       num_iters = k;
     }
+    Kokkos::deep_copy(y, x);
     return num_iters;
   }
 
@@ -425,7 +1298,775 @@ struct cgsolve {
            spmv_calls, dot_calls, axpby_calls);
   }
 
+  template <class VType> double max_diff(VType a, VType b) {
+    double result = 0;
+    Kokkos::parallel_reduce(
+        "MAX_DIFF", a.extent(0),
+        KOKKOS_LAMBDA(const int64_t &i, double &lmax) {
+          double d = a(i) > b(i) ? a(i) - b(i) : b(i) - a(i);
+          if (d > lmax)
+            lmax = d;
+        },
+        Kokkos::Max<double>(result));
+    return result;
+  }
+
+  // Time both transpose-safe kernels, keep the faster one per backend for
+  // the CG solves.
+  void run_sym_spmv_test(int R) {
+    Kokkos::View<double *> y_atomic("Y_atomic", y.extent(0));
+    Kokkos::View<double *> y_colored("Y_colored", y.extent(0));
+    double matrix_bytes = A_sym.num_rows() * sizeof(int64_t) +
+                          A_sym.nnz() * (sizeof(int64_t) + sizeof(double));
+
+    double t_atomic =
+        time_kernel([&]() { spmv_sym_atomic(y_atomic, A_sym, x); }, R);
+    double t_colored =
+        time_kernel([&]() { spmv_sym_colored(y_colored, A_sym, x); }, R);
+    sym_atomic_kk = t_atomic <= t_colored;
+    printf("KK: SymSPMV atomic %e s colored %e s (max diff %e) -> %s\n",
+           t_atomic, t_colored, max_diff(y_atomic, y_colored),
+           sym_atomic_kk ? "atomic" : "colored");
+
+    t_atomic =
+        time_kernel([&]() { spmv_sym_atomic_ompt(y_atomic, A_sym, x); }, R);
+    t_colored =
+        time_kernel([&]() { spmv_sym_colored_ompt(y_colored, A_sym, x); }, R);
+    sym_atomic_ompt = t_atomic <= t_colored;
+    printf("OMPT: SymSPMV atomic %e s colored %e s (max diff %e) -> %s\n",
+           t_atomic, t_colored, max_diff(y_atomic, y_colored),
+           sym_atomic_ompt ? "atomic" : "colored");
+
+    printf("SymSPMV: upper triangle nnz %li, block size %li, matrix %lf GB\n",
+           A_sym.nnz(), A_sym.block_size,
+           matrix_bytes / 1024 / 1024 / 1024);
+  }
+
+  template <class AType>
+  void run_merge_spmv_case(const char *name, AType A, int R) {
+    int64_t nrows = A.num_rows();
+    Kokkos::View<double *> xs("X_merge", nrows);
+    Kokkos::View<double *> y_row("Y_row", nrows);
+    Kokkos::View<double *> y_merge("Y_merge", nrows);
+    Kokkos::parallel_for(
+        "INIT_X", nrows,
+        KOKKOS_LAMBDA(const int64_t i) { xs(i) = 1.0 + (i % 17) * 0.125; });
+
+    int64_t nnz = 0;
+    Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, nrows));
+    int64_t max_row_length = 0;
+    Kokkos::parallel_reduce(
+        "MAX_ROW", nrows,
+        KOKKOS_LAMBDA(const int64_t row, int64_t &lmax) {
+          const int64_t length = A.row_ptr(row + 1) - A.row_ptr(row);
+          if (length > lmax)
+            lmax = length;
+        },
+        Kokkos::Max<int64_t>(max_row_length));
+
+    double bytes = nrows * sizeof(int64_t) +
+                   nnz * (sizeof(int64_t) + sizeof(double) * 2) +
+                   nrows * sizeof(double);
+    double GB = bytes / 1024 / 1024 / 1024;
+    printf("%s: rows %li nnz %li avg row %.1lf max row %li\n", name, nrows,
+           nnz, double(nnz) / nrows, max_row_length);
+
+    double t_row = time_kernel([&]() { spmv(y_row, A, xs); }, R);
+    double t_merge = time_kernel([&]() { spmv_merge(y_merge, A, xs); }, R);
+    printf("KK: row-based %e s %lf GB/s merge-path %e s %lf GB/s (max diff "
+           "%e)\n",
+           t_row, GB / t_row, t_merge, GB / t_merge, max_diff(y_row, y_merge));
+
+    t_row = time_kernel([&]() { spmv_ompt(y_row, A, xs); }, R);
+    t_merge = time_kernel([&]() { spmv_merge_ompt(y_merge, A, xs); }, R);
+    printf("OMPT: row-based %e s %lf GB/s merge-path %e s %lf GB/s (max diff "
+           "%e)\n",
+           t_row, GB / t_row, t_merge, GB / t_merge, max_diff(y_row, y_merge));
+  }
+
+  // Row-based vs merge-path SpMV on the miniFE matrix and on a matrix of
+  // the same size with heavily skewed row lengths.
+  void run_merge_spmv_test(int R) {
+    if (!symmetric)
+      run_merge_spmv_case("miniFE", A, R);
+
+    int64_t nrows = x.extent(0);
+    auto A_skewed = Impl::generate_skewed_matrix<
+        Kokkos::DefaultExecutionSpace::memory_space>(nrows, 8, nrows / 4);
+    run_merge_spmv_case("skewed", A_skewed, R);
+  }
+
+  // Scratch-staged SpMV against the plain kernel, for a few team sizes and
+  // both scratch levels. The hit ratio is the fraction of nonzeros whose x
+  // gather was served from scratch.
+  void run_scratch_spmv_test(int R) {
+    if (symmetric) {
+      printf("SPMV scratch test needs the full matrix, run without --sym\n");
+      return;
+    }
+    int64_t nnz = 0;
+    Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, A.num_rows()));
+    Kokkos::View<double *> y_ref("Y_ref", y.extent(0));
+    Kokkos::View<double *> y_scratch("Y_scratch", y.extent(0));
+
+    double t_ref = time_kernel([&]() { spmv(y_ref, A, x); }, R);
+    printf("KK: SPMV direct %e s\n", t_ref);
+
+    int rows_per_team[] = {32, 128, 512};
+    for (int level = 0; level < 2; ++level) {
+      size_t scratch_bytes = Kokkos::TeamPolicy<>::scratch_size_max(level);
+      // Level 1 can be very large; one MB per team is plenty for a window.
+      if (scratch_bytes > (1 << 20))
+        scratch_bytes = 1 << 20;
+      for (int rpt : rows_per_team) {
+        int64_t staged = 0;
+        double t = time_kernel(
+            [&]() {
+              staged = spmv_scratch(y_scratch, A, x, rpt, level, scratch_bytes);
+            },
+            R);
+        printf("KK: SPMV scratch level %i (%zu bytes) rows/team %i: %e s "
+               "speedup %lf hit ratio %lf (max diff %e)\n",
+               level, scratch_bytes, rpt, t, t_ref / t, double(staged) / nnz,
+               max_diff(y_ref, y_scratch));
+      }
+    }
+
+    t_ref = time_kernel([&]() { spmv_ompt(y_ref, A, x); }, R);
+    printf("OMPT: SPMV direct %e s\n", t_ref);
+    for (int rpt : rows_per_team) {
+      int64_t staged = 0;
+      double t = time_kernel(
+          [&]() { staged = spmv_scratch_ompt(y_scratch, A, x, rpt); }, R);
+      printf("OMPT: SPMV scratch (%zu bytes) rows/team %i: %e s speedup %lf "
+             "hit ratio %lf (max diff %e)\n",
+             SPMV_SCRATCH_WINDOW * sizeof(double), rpt, t, t_ref / t,
+             double(staged) / nnz, max_diff(y_ref, y_scratch));
+    }
+  }
+
+  // Split col_idx/values against 16- and 12-byte interleaved entries, per
+  // nonzero, for a range of team sizes (one row per thread).
+  void run_interleaved_spmv_test(int R) {
+    if (symmetric) {
+      printf("SPMV layout test needs the full matrix, run without --sym\n");
+      return;
+    }
+    using MemSpace = Kokkos::DefaultExecutionSpace::memory_space;
+    int64_t nnz = 0;
+    Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, A.num_rows()));
+    auto A16 = Impl::interleave<CrsEntry16>(A);
+    bool use12 = A.num_cols() <= INT32_MAX;
+    InterleavedCrsMatrix<CrsEntry12, MemSpace> A12;
+    if (use12)
+      A12 = Impl::interleave<CrsEntry12>(A);
+    else
+      printf("Skipping 12 byte entries: columns do not fit in 32 bits\n");
+
+    Kokkos::View<double *> y_ref("Y_ref", y.extent(0));
+    Kokkos::View<double *> y_il("Y_interleaved", y.extent(0));
+    spmv(y_ref, A, x);
+
+#if defined(KOKKOS_ENABLE_CUDA) || defined(KOKKOS_ENABLE_OPENMPTARGET)
+    int team_sizes[] = {16, 32, 64, 128};
+#else
+    int team_sizes[] = {1};
+#endif
+    // Giga-nonzeros per second.
+    auto gnnz = [&](double t) { return 1e-9 * nnz / t; };
+    for (int ts : team_sizes) {
+      double t_split = time_kernel([&]() { spmv(y_ref, A, x, ts, ts); }, R);
+      double t_16 =
+          time_kernel([&]() { spmv_interleaved(y_il, A16, x, ts, ts); }, R);
+      double diff = max_diff(y_ref, y_il);
+      double t_12 = 0;
+      if (use12) {
+        t_12 =
+            time_kernel([&]() { spmv_interleaved(y_il, A12, x, ts, ts); }, R);
+        diff = diff > max_diff(y_ref, y_il) ? diff : max_diff(y_ref, y_il);
+      }
+      printf("KK: team size %i: split %lf Gnnz/s AoS16 %lf Gnnz/s AoS12 %lf "
+             "Gnnz/s (max diff %e)\n",
+             ts, gnnz(t_split), gnnz(t_16), use12 ? gnnz(t_12) : 0., diff);
+    }
+
+    for (int nt = 1; nt <= 256; nt *= 2) {
+#if !defined(KOKKOS_ENABLE_CUDA) && !defined(KOKKOS_ENABLE_OPENMPTARGET)
+      if (nt > omp_get_max_threads())
+        break;
+#endif
+      double t_split =
+          time_kernel([&]() { spmv_ompt(y_ref, A, x, 32, nt); }, R);
+      double t_16 = time_kernel(
+          [&]() { spmv_interleaved_ompt(y_il, A16, x, 32, nt); }, R);
+      double diff = max_diff(y_ref, y_il);
+      double t_12 = 0;
+      if (use12) {
+        t_12 = time_kernel(
+            [&]() { spmv_interleaved_ompt(y_il, A12, x, 32, nt); }, R);
+        diff = diff > max_diff(y_ref, y_il) ? diff : max_diff(y_ref, y_il);
+      }
+      printf("OMPT: threads %i: split %lf Gnnz/s AoS16 %lf Gnnz/s AoS12 %lf "
+             "Gnnz/s (max diff %e)\n",
+             nt, gnnz(t_split), gnnz(t_16), use12 ? gnnz(t_12) : 0., diff);
+    }
+    printf("Bytes per nonzero: split %zu AoS16 %zu AoS12 %zu\n",
+           sizeof(int64_t) + sizeof(double), sizeof(CrsEntry16),
+           sizeof(CrsEntry12));
+  }
+
+  template <class AType>
+  void print_ordering(const char *name, AType A, double spmv_time) {
+    int64_t bandwidth = 0, profile = 0;
+    Impl::bandwidth_profile(A, bandwidth, profile);
+    printf("%s: bandwidth %li profile %li SPMV %e s\n", name, bandwidth,
+           profile, spmv_time);
+  }
+
+  // Scramble the miniFE ordering to emulate a badly ordered input, then
+  // recover locality with RCM. Reports bandwidth, profile and SpMV time of
+  // each ordering, the one-time reordering cost, and checks that the
+  // solution of the reordered system maps back to the scrambled one.
+  void run_rcm_test(int R) {
+    if (symmetric) {
+      printf("RCM test needs the full matrix, run without --sym\n");
+      return;
+    }
+    using MemSpace = Kokkos::DefaultExecutionSpace::memory_space;
+    Kokkos::View<double *> y_tmp("Y_tmp", y.extent(0));
+
+    print_ordering("natural", A, time_kernel([&]() { spmv(y_tmp, A, x); }, R));
+
+    auto scramble = Impl::scramble_permutation<MemSpace>(A.num_rows());
+    auto A_scr = Impl::permute_matrix(A, scramble);
+    auto b_scr = Impl::permute_vector(x, scramble);
+    print_ordering("scrambled", A_scr,
+                   time_kernel([&]() { spmv(y_tmp, A_scr, b_scr); }, R));
+
+    Kokkos::Timer timer;
+    auto perm = Impl::rcm_permutation(A_scr);
+    Kokkos::fence();
+    double t_perm = timer.seconds();
+    timer.reset();
+    auto A_rcm = Impl::permute_matrix(A_scr, perm);
+    auto b_rcm = Impl::permute_vector(b_scr, perm);
+    Kokkos::fence();
+    double t_apply = timer.seconds();
+    print_ordering("rcm", A_rcm,
+                   time_kernel([&]() { spmv(y_tmp, A_rcm, b_rcm); }, R));
+    printf("RCM: permutation %e s, applying it %e s\n", t_perm, t_apply);
+
+    Kokkos::View<double *> sol_scr("sol_scrambled", y.extent(0));
+    Kokkos::View<double *> sol_rcm("sol_rcm", y.extent(0));
+    timer.reset();
+    int iters_scr = cg_solve_kk(sol_scr, A_scr, b_scr, max_iter, tolerance);
+    double t_scr = timer.seconds();
+    timer.reset();
+    int iters_rcm = cg_solve_kk(sol_rcm, A_rcm, b_rcm, max_iter, tolerance);
+    double t_rcm = timer.seconds();
+    printf("KK: CGSolve scrambled %i iterations %lf s, rcm %i iterations %lf "
+           "s (max diff of mapped-back solution %e)\n",
+           iters_scr, t_scr, iters_rcm, t_rcm,
+           max_diff(sol_scr, Impl::unpermute_vector(sol_rcm, perm)));
+  }
+
+  // Pick the SpMV kernel for A on both backends. A cached decision for the
+  // same fingerprint is reused, otherwise every candidate is timed R times
+  // against the same x and the fastest one that reproduces the plain CSR
+  // result is kept and recorded in the cache.
+  template <class MemSpace>
+  TunedCrsMatrix<MemSpace> select_spmv_format(const CrsMatrix<MemSpace> &A,
+                                              const MatrixStats &stats,
+                                              SpmvFormatCache &cache, int R) {
+    TunedCrsMatrix<MemSpace> T;
+    T.csr = A;
+    std::string kk = std::string("KK:") + Kokkos::DefaultExecutionSpace::name();
+    std::string ompt = "OMPT";
+    int format[2] = {cache.lookup(stats.fingerprint, kk.c_str()),
+                     cache.lookup(stats.fingerprint, ompt.c_str())};
+
+    if (format[0] < 0 || format[1] < 0) {
+      T.interleaved = Impl::interleave<CrsEntry16>(A);
+      int64_t nrows = A.num_rows();
+      Kokkos::View<double *> xs("X_select", nrows);
+      Kokkos::View<double *> y_ref("Y_ref", nrows);
+      Kokkos::View<double *> y_test("Y_test", nrows);
+      Kokkos::parallel_for(
+          "INIT_X", nrows,
+          KOKKOS_LAMBDA(const int64_t i) { xs(i) = 1.0 + (i % 17) * 0.125; });
+      spmv(y_ref, A, xs);
+
+      for (int backend = 0; backend < 2; ++backend) {
+        if (format[backend] >= 0)
+          continue;
+        const char *tag = backend == 0 ? "KK" : "OMPT";
+        double best = 0;
+        for (int f = 0; f < SPMV_NUM_FORMATS; ++f) {
+          if (backend == 0)
+            T.format_kk = f;
+          else
+            T.format_ompt = f;
+          double t = backend == 0
+                         ? time_kernel([&]() { spmv(y_test, T, xs); }, R)
+                         : time_kernel([&]() { spmv_ompt(y_test, T, xs); }, R);
+          double diff = max_diff(y_ref, y_test);
+          bool valid = diff <= 1e-12 * (1 + stats.max_row_length);
+          printf("%s: SPMV %-12s %e s (max diff %e)%s\n", tag,
+                 spmv_format_name(f), t, diff, valid ? "" : " rejected");
+          if (valid && (format[backend] < 0 || t < best)) {
+            format[backend] = f;
+            best = t;
+          }
+        }
+        cache.store(stats.fingerprint, backend == 0 ? kk.c_str() : ompt.c_str(),
+                    format[backend]);
+      }
+    } else {
+      printf("SPMV format for fingerprint %016lx found in %s\n",
+             stats.fingerprint, cache.path.c_str());
+    }
+
+    T.format_kk = format[0];
+    T.format_ompt = format[1];
+    if (T.format_kk != SPMV_INTERLEAVED && T.format_ompt != SPMV_INTERLEAVED)
+      T.interleaved = InterleavedCrsMatrix<CrsEntry16, MemSpace>();
+    else if (T.interleaved.entries.extent(0) == 0)
+      T.interleaved = Impl::interleave<CrsEntry16>(A);
+    printf("KK: SPMV format %s\nOMPT: SPMV format %s\n",
+           spmv_format_name(T.format_kk), spmv_format_name(T.format_ompt));
+    return T;
+  }
+
+  // Rebuild A from shuffled triplets in which every entry is split into two
+  // halves, as an assembly code would hand them over, and check the result
+  // with an SpMV against A. The OpenMP builder is timed for 1, 2, 4, ...
+  // host threads.
+  void run_coo_test(int R) {
+    if (symmetric) {
+      printf("COO test needs the full matrix, run without --sym\n");
+      return;
+    }
+    using MemSpace = Kokkos::DefaultExecutionSpace::memory_space;
+    const int64_t nrows = A.num_rows();
+    int64_t nnz = 0;
+    Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, nrows));
+    const int64_t n = 2 * nnz;
+    Kokkos::View<int64_t *> rows("coo::rows", n);
+    Kokkos::View<int64_t *> cols("coo::cols", n);
+    Kokkos::View<double *> vals("coo::vals", n);
+    auto shuffle = Impl::scramble_permutation<MemSpace>(n);
+    auto A_ = A;
+    Kokkos::parallel_for(
+        "MAKE_TRIPLETS", nrows, KOKKOS_LAMBDA(const int64_t row) {
+          for (int64_t i = A_.row_ptr(row); i < A_.row_ptr(row + 1); ++i)
+            for (int64_t h = 0; h < 2; ++h) {
+              const int64_t t = shuffle(2 * i + h);
+              rows(t) = row;
+              cols(t) = A_.col_idx(i);
+              vals(t) = 0.5 * A_.values(i);
+            }
+        });
+
+    Kokkos::View<double *> y_ref("Y_ref", nrows);
+    Kokkos::View<double *> y_coo("Y_coo", nrows);
+    spmv(y_ref, A, x);
+
+    CrsMatrix<MemSpace> B;
+    double t = time_kernel(
+        [&]() {
+          B = Impl::coo_to_crs<MemSpace>(nrows, A.num_cols(), rows, cols,
+                                         vals);
+        },
+        R);
+    int64_t B_nnz = 0;
+    Kokkos::deep_copy(B_nnz, Kokkos::subview(B.row_ptr, nrows));
+    spmv(y_coo, B, x);
+    printf("KK: COO to CSR %li triplets -> %li nonzeros %e s %lf Mtriplets/s "
+           "(max diff %e)\n",
+           n, B_nnz, t, 1e-6 * n / t, max_diff(y_ref, y_coo));
+
+    auto h_rows =
+        Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), rows);
+    auto h_cols =
+        Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), cols);
+    auto h_vals =
+        Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), vals);
+    CrsMatrix<Kokkos::HostSpace> h_B;
+    double t_1 = 0;
+    for (int nt = 1; nt <= omp_get_max_threads(); nt *= 2) {
+      t = time_kernel(
+          [&]() {
+            h_B = Impl::coo_to_crs_openmp(nrows, A.num_cols(), h_rows.data(),
+                                          h_cols.data(), h_vals.data(), n,
+                                          nt);
+          },
+          R);
+      if (nt == 1)
+        t_1 = t;
+      B = CrsMatrix<MemSpace>(
+          Kokkos::create_mirror_view_and_copy(MemSpace(), h_B.row_ptr),
+          Kokkos::create_mirror_view_and_copy(MemSpace(), h_B.col_idx),
+          Kokkos::create_mirror_view_and_copy(MemSpace(), h_B.values),
+          h_B.num_cols());
+      spmv(y_coo, B, x);
+      printf("OMP: COO to CSR threads %i: %e s %lf Mtriplets/s speedup %lf "
+             "(max diff %e)\n",
+             nt, t, 1e-6 * n / t, t_1 / t, max_diff(y_ref, y_coo));
+    }
+  }
+
+  template <class AType>
+  void run_transpose_case(const char *name, AType A, int R) {
+    int64_t nrows = A.num_rows();
+    Kokkos::View<double *> xs("X_transpose", nrows);
+    Kokkos::parallel_for(
+        "INIT_X", nrows,
+        KOKKOS_LAMBDA(const int64_t i) { xs(i) = 1.0 + (i % 17) * 0.125; });
+
+    Kokkos::Timer timer;
+    auto At = Impl::transpose(A);
+    Kokkos::fence();
+    double t_transpose = timer.seconds();
+    int64_t ncols = At.num_rows();
+    Kokkos::View<double *> y_explicit("Y_explicit", ncols);
+    Kokkos::View<double *> y_atomic("Y_atomic", ncols);
+    printf("%s: %li x %li, transpose %e s\n", name, nrows, ncols,
+           t_transpose);
+
+    // Applications of A^T after which forming it explicitly has paid off.
+    auto break_even = [&](double t_explicit, double t_atomic) {
+      return t_atomic > t_explicit ? t_transpose / (t_atomic - t_explicit)
+                                   : -1.;
+    };
+    double t_explicit = time_kernel([&]() { spmv(y_explicit, At, xs); }, R);
+    double t_atomic =
+        time_kernel([&]() { spmv_transpose_atomic(y_atomic, A, xs); }, R);
+    printf("KK: A^T x explicit %e s atomic %e s break-even %.1lf "
+           "applications (max diff %e)\n",
+           t_explicit, t_atomic, break_even(t_explicit, t_atomic),
+           max_diff(y_explicit, y_atomic));
+
+    t_explicit = time_kernel([&]() { spmv_ompt(y_explicit, At, xs); }, R);
+    t_atomic =
+        time_kernel([&]() { spmv_transpose_atomic_ompt(y_atomic, A, xs); }, R);
+    printf("OMPT: A^T x explicit %e s atomic %e s break-even %.1lf "
+           "applications (max diff %e)\n",
+           t_explicit, t_atomic, break_even(t_explicit, t_atomic),
+           max_diff(y_explicit, y_atomic));
+  }
+
+  // Explicit transpose plus row-based SpMV against the atomic scatter
+  // kernel, on the miniFE matrix (numerically symmetric, so A^T x = A x is
+  // checked too) and on the non-symmetric skewed matrix. A break-even of -1
+  // means the atomic kernel is never slower.
+  void run_transpose_test(int R) {
+    if (!symmetric) {
+      run_transpose_case("miniFE", A, R);
+      Kokkos::View<double *> y_t("Y_t", y.extent(0));
+      spmv(y, A, x);
+      spmv_transpose_atomic(y_t, A, x);
+      printf("miniFE: max |A^T x - A x| %e\n", max_diff(y, y_t));
+    }
+
+    int64_t nrows = x.extent(0);
+    auto A_skewed = Impl::generate_skewed_matrix<
+        Kokkos::DefaultExecutionSpace::memory_space>(nrows, 8, nrows / 4);
+    run_transpose_case("skewed", A_skewed, R);
+  }
+
+  // C = A * A for the miniFE matrix at N/4, N/2 and N, checked as
+  // C x = A (A x). The numeric phase is then rerun in the same structure
+  // after doubling A, as a time step with new values would, and has to
+  // give 4 C.
+  void run_spgemm_test(int R) {
+    using MemSpace = Kokkos::DefaultExecutionSpace::memory_space;
+    for (int n : {N / 4, N / 2, N}) {
+      if (n < 2)
+        continue;
+      auto A_n = Impl::generate_miniFE_matrix<MemSpace>(n);
+      auto x_n = Impl::generate_miniFE_vector<MemSpace>(n);
+      const int64_t nrows = A_n.num_rows();
+      int64_t products = 0;
+      Kokkos::parallel_reduce(
+          "SPGEMM_PRODUCTS", nrows,
+          KOKKOS_LAMBDA(const int64_t row, int64_t &lsum) {
+            for (int64_t k = A_n.row_ptr(row); k < A_n.row_ptr(row + 1); ++k)
+              lsum += A_n.row_ptr(A_n.col_idx(k) + 1) -
+                      A_n.row_ptr(A_n.col_idx(k));
+          },
+          products);
+
+      CrsMatrix<MemSpace> C;
+      double t_symbolic =
+          time_kernel([&]() { C = Impl::spgemm_symbolic(A_n, A_n); }, R);
+      double t_numeric =
+          time_kernel([&]() { Impl::spgemm_numeric(A_n, A_n, C); }, R);
+      int64_t C_nnz = 0;
+      Kokkos::deep_copy(C_nnz, Kokkos::subview(C.row_ptr, nrows));
+
+      Kokkos::View<double *> y_A("Y_A", nrows);
+      Kokkos::View<double *> y_AA("Y_AA", nrows);
+      Kokkos::View<double *> y_C("Y_C", nrows);
+      spmv(y_A, A_n, x_n);
+      spmv(y_AA, A_n, y_A);
+      spmv(y_C, C, x_n);
+      double diff = max_diff(y_AA, y_C);
+
+      Kokkos::parallel_for(
+          "SCALE_A", A_n.values.extent(0),
+          KOKKOS_LAMBDA(const int64_t i) { A_n.values(i) *= 2.; });
+      Kokkos::Timer timer;
+      Impl::spgemm_numeric(A_n, A_n, C);
+      Kokkos::fence();
+      double t_reuse = timer.seconds();
+      axpby(y_AA, 4., y_C, 0., y_C);
+      spmv(y_C, C, x_n);
+
+      printf("KK: SpGEMM A*A for %i^3: %li rows, %li products, nnz(C) %li, "
+             "symbolic %e s numeric %e s (%lf GFlop/s) reuse %e s (max diff "
+             "%e, after reuse %e)\n",
+             n, nrows, products, C_nnz, t_symbolic, t_numeric,
+             1e-9 * 2 * products / t_numeric, t_reuse, diff,
+             max_diff(y_AA, y_C));
+    }
+  }
+
+  template <class AType>
+  int run_spmv_suite_case(const char *name, AType A, int R) {
+    using MemSpace = Kokkos::DefaultExecutionSpace::memory_space;
+    const int64_t nrows = A.num_rows();
+    int64_t nnz = 0;
+    Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, nrows));
+    int64_t max_row_length = 0;
+    Kokkos::parallel_reduce(
+        "MAX_ROW", nrows,
+        KOKKOS_LAMBDA(const int64_t row, int64_t &lmax) {
+          const int64_t length = A.row_ptr(row + 1) - A.row_ptr(row);
+          if (length > lmax)
+            lmax = length;
+        },
+        Kokkos::Max<int64_t>(max_row_length));
+    printf("%s: rows %li nnz %li avg row %.1lf max row %li\n", name, nrows,
+           nnz, double(nnz) / nrows, max_row_length);
+
+    TunedCrsMatrix<MemSpace> T;
+    T.csr = A;
+    T.interleaved = Impl::interleave<CrsEntry16>(A);
+    Kokkos::View<double *> xs("X_suite", nrows);
+    Kokkos::View<double *> y_ref("Y_ref", nrows);
+    Kokkos::View<double *> y_test("Y_test", nrows);
+    Kokkos::parallel_for(
+        "INIT_X", xs.extent(0),
+        KOKKOS_LAMBDA(const int64_t i) { xs(i) = 1.0 + (i % 17) * 0.125; });
+    spmv(y_ref, A, xs);
+
+    int failures = 0;
+    for (int backend = 0; backend < 2; ++backend) {
+      for (int f = 0; f < SPMV_NUM_FORMATS; ++f) {
+        T.format_kk = T.format_ompt = f;
+        double t = backend == 0
+                       ? time_kernel([&]() { spmv(y_test, T, xs); }, R)
+                       : time_kernel([&]() { spmv_ompt(y_test, T, xs); }, R);
+        double diff = max_diff(y_ref, y_test);
+        bool valid = diff <= 1e-12 * (1 + max_row_length);
+        if (!valid)
+          ++failures;
+        printf("%s: %s %-12s %e s %lf Gnnz/s (max diff %e)%s\n",
+               backend == 0 ? "KK" : "OMPT", name, spmv_format_name(f), t,
+               1e-9 * nnz / t, diff, valid ? "" : " FAILED");
+      }
+    }
+    return failures;
+  }
+
+  // SpMV regression suite: every kernel the format selector can pick, on
+  // both backends, over every matrix generator at about N^3/8 and N^3 rows,
+  // each result checked against the row-based CSR kernel. Returns the
+  // number of failed checks.
+  int run_spmv_suite(int R) {
+    using MemSpace = Kokkos::DefaultExecutionSpace::memory_space;
+    const int64_t N3 = int64_t(N) * N * N;
+    int failures = 0;
+    for (int64_t target : {N3 / 8, N3}) {
+      if (target < 1)
+        target = 1;
+      const int64_t side2 = std::llround(std::sqrt(double(target)));
+      const int64_t side3 = std::llround(std::cbrt(double(target)));
+      // miniFE has (elements + 1)^3 rows; at least one element.
+      const int64_t elements = side3 > 1 ? side3 - 1 : 1;
+      int scale = 1;
+      while ((int64_t(2) << scale) <= target)
+        ++scale;
+      printf("SpMV suite at %li rows\n", target);
+      failures += run_spmv_suite_case(
+          "miniFE", Impl::generate_miniFE_matrix<MemSpace>(elements), R);
+      failures += run_spmv_suite_case(
+          "laplace2d",
+          Impl::generate_laplace2d_matrix<MemSpace>(side2, side2), R);
+      failures += run_spmv_suite_case(
+          "laplace3d",
+          Impl::generate_laplace3d_matrix<MemSpace>(side3, side3, side3), R);
+      failures += run_spmv_suite_case(
+          "banded",
+          Impl::generate_banded_random_matrix<MemSpace>(target, 32, 0.25), R);
+      failures += run_spmv_suite_case(
+          "rmat", Impl::generate_rmat_matrix<MemSpace>(scale, 8), R);
+      failures += run_spmv_suite_case(
+          "skewed",
+          Impl::generate_skewed_matrix<MemSpace>(target, 8, target / 4), R);
+    }
+    printf("SpMV suite: %i failed checks\n", failures);
+    return failures;
+  }
+
+  // Assemble the 27-point matrix of an N^3 hex mesh from 8x8 element
+  // matrices with every strategy. KK runs coloring and atomics on the
+  // default space, OMP runs all three for 1, 2, 4, ... host threads. Every
+  // result is checked against the KK colored one.
+  void run_assembly_test(int R) {
+    using MemSpace = Kokkos::DefaultExecutionSpace::memory_space;
+    const HexMesh mesh{N, N, N};
+    auto A_fe = Impl::generate_hex_graph<MemSpace>(mesh);
+    const int64_t nnz = A_fe.values.extent(0);
+    const int64_t nelements = mesh.num_elements();
+    printf("Assembly: %li elements %li nodes %li nonzeros\n", nelements,
+           mesh.num_nodes(), nnz);
+
+    Impl::assemble_hex(A_fe, mesh, ASSEMBLY_COLORED);
+    Kokkos::View<double *, MemSpace> ref("assembly::ref", nnz);
+    Kokkos::deep_copy(ref, A_fe.values);
+    // Element matrices have zero row sums, so A 1 = 0.
+    Kokkos::View<double *> ones("assembly::ones", mesh.num_nodes());
+    Kokkos::View<double *> zeros("assembly::zeros", mesh.num_nodes());
+    Kokkos::View<double *> row_sums("assembly::row_sums", mesh.num_nodes());
+    Kokkos::deep_copy(ones, 1.0);
+    spmv(row_sums, A_fe, ones);
+    printf("Assembly: max |A 1| %e\n", max_diff(row_sums, zeros));
+    for (int s = ASSEMBLY_COLORED; s <= ASSEMBLY_ATOMIC; ++s) {
+      double t = time_kernel([&]() { Impl::assemble_hex(A_fe, mesh, s); }, R);
+      printf("KK: assembly %-8s %e s %lf Melements/s (max diff %e)\n",
+             assembly_strategy_name(s), t, 1e-6 * nelements / t,
+             max_diff(ref, A_fe.values));
+    }
+
+    auto h_A = Impl::generate_hex_graph<Kokkos::HostSpace>(mesh);
+    Kokkos::View<double *, MemSpace> values("assembly::values", nnz);
+    for (int nt = 1; nt <= omp_get_max_threads(); nt *= 2) {
+      double t[ASSEMBLY_NUM_STRATEGIES];
+      double diff = 0;
+      int best = 0;
+      for (int s = 0; s < ASSEMBLY_NUM_STRATEGIES; ++s) {
+        t[s] = time_kernel(
+            [&]() { Impl::assemble_hex_openmp(h_A, mesh, s, nt); }, R);
+        Kokkos::deep_copy(values, h_A.values);
+        double d = max_diff(ref, values);
+        if (d > diff)
+          diff = d;
+        if (t[s] < t[best])
+          best = s;
+      }
+      printf("OMP: assembly threads %i: colored %e s atomic %e s private %e "
+             "s -> %s %lf Melements/s (max diff %e)\n",
+             nt, t[ASSEMBLY_COLORED], t[ASSEMBLY_ATOMIC], t[ASSEMBLY_PRIVATE],
+             assembly_strategy_name(best), 1e-6 * nelements / t[best], diff);
+    }
+  }
+
+  // Analyze A, choose the SpMV kernels and run both CG solves with them.
+  void run_auto_test() {
+    if (symmetric) {
+      printf("SPMV format selection needs the full matrix, run without "
+             "--sym\n");
+      return;
+    }
+    Kokkos::Timer timer;
+    MatrixStats stats = Impl::analyze_matrix(A);
+    printf("Analysis: %e s\n", timer.seconds());
+    stats.print("miniFE");
+
+    SpmvFormatCache cache(spmv_cache_path);
+    timer.reset();
+    auto T = select_spmv_format(A, stats, cache, 5);
+    printf("Selection: %e s\n", timer.seconds());
+
+    // Same traffic model as run_kk_test, with the exact nonzero count.
+    double spmv_bytes = stats.num_rows * sizeof(int64_t) +
+                        stats.nnz * (sizeof(int64_t) + sizeof(double) * 2) +
+                        stats.num_rows * sizeof(double);
+    double spmv_flops = stats.nnz * 2;
+
+    printf("*******Kokkos***************\n");
+    timer.reset();
+    int num_iters = cg_solve_kk(y, T, x, max_iter, tolerance);
+    print_performance("KK", num_iters, timer.seconds(), spmv_bytes,
+                      spmv_flops);
+
+    printf("*******OpenMPTarget***************\n");
+    timer.reset();
+    num_iters = cg_solve_ompt(y, T, x, max_iter, tolerance);
+    print_performance("OMPT", num_iters, timer.seconds(), spmv_bytes,
+                      spmv_flops);
+  }
+
+  void print_performance(const char *tag, int num_iters, double time,
+                         double spmv_bytes, double spmv_flops) {
+    double dot_bytes = x.extent(0) * sizeof(double) * 2;
+    double axpby_bytes = x.extent(0) * sizeof(double) * 3;
+
+    double dot_flops = x.extent(0) * 2;
+    double axpby_flops = x.extent(0) * 3;
+
+    int spmv_calls = 1 + num_iters;
+    int dot_calls = num_iters;
+    int axpby_calls = 2 + num_iters * 3;
+
+    printf("%s: CGSolve for 3D (%i %i %i); %i iterations; %lf time\n", tag, N,
+           N, N, num_iters, time);
+    printf("%s: Performance: %lf GFlop/s %lf GB/s (Calls SPMV: %i Dot: %i "
+           "AXPBY: %i\n",
+           tag,
+           1e-9 *
+               (spmv_flops * spmv_calls + dot_flops * dot_calls +
+                axpby_flops * axpby_calls) /
+               time,
+           (1.0 / 1024 / 1024 / 1024) *
+               (spmv_bytes * spmv_calls + dot_bytes * dot_calls +
+                axpby_bytes * axpby_calls) /
+               time,
+           spmv_calls, dot_calls, axpby_calls);
+  }
+
+  void run_sym_test() {
+    run_sym_spmv_test(10);
+
+    // Matrix read once, x read for the gather and at the row, y zeroed and
+    // updated for the row and every transposed entry.
+    double spmv_bytes = A_sym.num_rows() * sizeof(int64_t) +
+                        A_sym.nnz() * sizeof(int64_t) +
+                        A_sym.nnz() * sizeof(double) +
+                        A_sym.nnz() * sizeof(double) +
+                        A_sym.nnz() * sizeof(double) * 2 +
+                        A_sym.num_rows() * sizeof(double) * 4;
+    double spmv_flops = (2 * A_sym.nnz() - A_sym.num_rows()) * 2;
+
+    printf("*******Kokkos***************\n");
+    Kokkos::Timer timer;
+    int num_iters = cg_solve_kk(y, A_sym, x, max_iter, tolerance);
+    print_performance("KK", num_iters, timer.seconds(), spmv_bytes,
+                      spmv_flops);
+
+    printf("*******OpenMPTarget***************\n");
+    timer.reset();
+    num_iters = cg_solve_ompt(y, A_sym, x, max_iter, tolerance);
+    print_performance("OMPT", num_iters, timer.seconds(), spmv_bytes,
+                      spmv_flops);
+  }
+
   void run_test() {
+    if (symmetric) {
+      run_sym_test();
+      return;
+    }
 
     printf("*******Kokkos***************\n");
     run_kk_test();
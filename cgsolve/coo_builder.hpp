@@ -0,0 +1,282 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef COO_BUILDER_HPP
+#define COO_BUILDER_HPP
+
+#include <omp.h>
+#include <vector>
+
+#include <generate_matrix.hpp>
+
+namespace Impl {
+
+template <class Less>
+KOKKOS_INLINE_FUNCTION void sift_down(int64_t *a, int64_t root, int64_t n,
+                                      const Less &less) {
+  while (2 * root + 1 < n) {
+    int64_t child = 2 * root + 1;
+    if (child + 1 < n && less(a[child], a[child + 1]))
+      ++child;
+    if (!less(a[root], a[child]))
+      return;
+    const int64_t tmp = a[root];
+    a[root] = a[child];
+    a[child] = tmp;
+    root = child;
+  }
+}
+
+// In-place sort of a[0, n): insertion sort for short ranges, heapsort for
+// long ones so a row with many duplicates stays O(n log n) without
+// scratch memory.
+template <class Less>
+KOKKOS_INLINE_FUNCTION void sort_indices(int64_t *a, int64_t n,
+                                         const Less &less) {
+  if (n <= 16) {
+    for (int64_t i = 1; i < n; ++i) {
+      const int64_t v = a[i];
+      int64_t j = i;
+      for (; j > 0 && less(v, a[j - 1]); --j)
+        a[j] = a[j - 1];
+      a[j] = v;
+    }
+    return;
+  }
+  for (int64_t root = n / 2 - 1; root >= 0; --root)
+    sift_down(a, root, n, less);
+  for (int64_t end = n - 1; end > 0; --end) {
+    const int64_t tmp = a[0];
+    a[0] = a[end];
+    a[end] = tmp;
+    sift_down(a, 0, end, less);
+  }
+}
+
+// Build a CrsMatrix from unsorted (row, col, value) triplets, summing
+// duplicates. Triplets are bucketed by row (count, scan, scatter), each
+// bucket is sorted by (col, triplet index), and the distinct columns of a
+// row are counted and scanned into row_ptr. Sorting on the triplet index
+// as well makes duplicates add up in input order, so the result does not
+// depend on the scatter order.
+template <class MemSpace>
+CrsMatrix<MemSpace> coo_to_crs(int64_t nrows, int64_t ncols,
+                               Kokkos::View<int64_t *, MemSpace> rows,
+                               Kokkos::View<int64_t *, MemSpace> cols,
+                               Kokkos::View<double *, MemSpace> vals) {
+  using policy_t = Kokkos::RangePolicy<typename MemSpace::execution_space>;
+  const int64_t n = rows.extent(0);
+
+  Kokkos::View<int64_t *, MemSpace> bucket("coo::bucket", nrows + 1);
+  Kokkos::parallel_for(
+      "CooCount", policy_t(0, n), KOKKOS_LAMBDA(const int64_t e) {
+        Kokkos::atomic_increment(&bucket(rows(e) + 1));
+      });
+  Kokkos::parallel_scan(
+      "CooBucketPtr", policy_t(0, nrows + 1),
+      KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+        update += bucket(i);
+        if (final)
+          bucket(i) = update;
+      });
+
+  Kokkos::View<int64_t *, MemSpace> fill("coo::fill", nrows);
+  Kokkos::View<int64_t *, MemSpace> perm(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "coo::perm"), n);
+  Kokkos::parallel_for(
+      "CooScatter", policy_t(0, n), KOKKOS_LAMBDA(const int64_t e) {
+        const int64_t r = rows(e);
+        perm(bucket(r) + Kokkos::atomic_fetch_add(&fill(r), int64_t(1))) = e;
+      });
+
+  Kokkos::View<int64_t *, MemSpace> row_ptr("coo::row_ptr", nrows + 1);
+  Kokkos::parallel_for(
+      "CooSortRows", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t r) {
+        const int64_t begin = bucket(r), end = bucket(r + 1);
+        sort_indices(perm.data() + begin, end - begin,
+                     [&](int64_t a, int64_t b) {
+                       return cols(a) < cols(b) ||
+                              (cols(a) == cols(b) && a < b);
+                     });
+        int64_t distinct = 0;
+        for (int64_t k = begin; k < end; ++k)
+          if (k == begin || cols(perm(k)) != cols(perm(k - 1)))
+            ++distinct;
+        row_ptr(r + 1) = distinct;
+      });
+  int64_t nnz = 0;
+  Kokkos::parallel_scan(
+      "CooRowPtr", policy_t(0, nrows + 1),
+      KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+        update += row_ptr(i);
+        if (final)
+          row_ptr(i) = update;
+      },
+      nnz);
+
+  Kokkos::View<int64_t *, MemSpace> col_idx(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "coo::col_idx"), nnz);
+  Kokkos::View<double *, MemSpace> values(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "coo::values"), nnz);
+  Kokkos::parallel_for(
+      "CooFill", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t r) {
+        int64_t pos = row_ptr(r) - 1;
+        for (int64_t k = bucket(r); k < bucket(r + 1); ++k) {
+          const int64_t e = perm(k);
+          if (k == bucket(r) || cols(e) != cols(perm(k - 1))) {
+            ++pos;
+            col_idx(pos) = cols(e);
+            values(pos) = vals(e);
+          } else {
+            values(pos) += vals(e);
+          }
+        }
+      });
+
+  return CrsMatrix<MemSpace>(row_ptr, col_idx, values, ncols);
+}
+
+// Inclusive prefix sum of a[0, n) with nthreads threads: every thread sums
+// its block, the block totals are scanned serially, and every thread then
+// scans its block starting from its offset.
+inline void openmp_inclusive_scan(int64_t *a, int64_t n, int nthreads) {
+  std::vector<int64_t> block_sum(nthreads + 1);
+#pragma omp parallel num_threads(nthreads)
+  {
+    const int t = omp_get_thread_num();
+    const int nt = omp_get_num_threads();
+    const int64_t begin = n * t / nt, end = n * (t + 1) / nt;
+    int64_t sum = 0;
+    for (int64_t i = begin; i < end; ++i)
+      sum += a[i];
+    block_sum[t + 1] = sum;
+#pragma omp barrier
+#pragma omp single
+    {
+      block_sum[0] = 0;
+      for (int b = 1; b <= nt; ++b)
+        block_sum[b] += block_sum[b - 1];
+    }
+    sum = block_sum[t];
+    for (int64_t i = begin; i < end; ++i) {
+      sum += a[i];
+      a[i] = sum;
+    }
+  }
+}
+
+// Host OpenMP version of coo_to_crs with an explicit thread count; same
+// algorithm and the same result.
+inline CrsMatrix<Kokkos::HostSpace>
+coo_to_crs_openmp(int64_t nrows, int64_t ncols, const int64_t *rows,
+                  const int64_t *cols, const double *vals, int64_t n,
+                  int nthreads) {
+  Kokkos::View<int64_t *, Kokkos::HostSpace> bucket_v("coo::bucket",
+                                                      nrows + 1);
+  Kokkos::View<int64_t *, Kokkos::HostSpace> fill_v("coo::fill", nrows);
+  Kokkos::View<int64_t *, Kokkos::HostSpace> perm_v(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "coo::perm"), n);
+  Kokkos::View<int64_t *, Kokkos::HostSpace> row_ptr("coo::row_ptr",
+                                                     nrows + 1);
+  int64_t *bucket = bucket_v.data();
+  int64_t *fill = fill_v.data();
+  int64_t *perm = perm_v.data();
+  int64_t *rp = row_ptr.data();
+
+#pragma omp parallel for num_threads(nthreads)
+  for (int64_t e = 0; e < n; ++e) {
+#pragma omp atomic
+    bucket[rows[e] + 1]++;
+  }
+  openmp_inclusive_scan(bucket, nrows + 1, nthreads);
+
+#pragma omp parallel for num_threads(nthreads)
+  for (int64_t e = 0; e < n; ++e) {
+    int64_t k;
+#pragma omp atomic capture
+    k = fill[rows[e]]++;
+    perm[bucket[rows[e]] + k] = e;
+  }
+
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic, 256)
+  for (int64_t r = 0; r < nrows; ++r) {
+    const int64_t begin = bucket[r], end = bucket[r + 1];
+    sort_indices(perm + begin, end - begin, [&](int64_t a, int64_t b) {
+      return cols[a] < cols[b] || (cols[a] == cols[b] && a < b);
+    });
+    int64_t distinct = 0;
+    for (int64_t k = begin; k < end; ++k)
+      if (k == begin || cols[perm[k]] != cols[perm[k - 1]])
+        ++distinct;
+    rp[r + 1] = distinct;
+  }
+  openmp_inclusive_scan(rp, nrows + 1, nthreads);
+
+  const int64_t nnz = rp[nrows];
+  Kokkos::View<int64_t *, Kokkos::HostSpace> col_idx(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "coo::col_idx"), nnz);
+  Kokkos::View<double *, Kokkos::HostSpace> values(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "coo::values"), nnz);
+  int64_t *ci = col_idx.data();
+  double *va = values.data();
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic, 256)
+  for (int64_t r = 0; r < nrows; ++r) {
+    int64_t pos = rp[r] - 1;
+    for (int64_t k = bucket[r]; k < bucket[r + 1]; ++k) {
+      const int64_t e = perm[k];
+      if (k == bucket[r] || cols[e] != cols[perm[k - 1]]) {
+        ++pos;
+        ci[pos] = cols[e];
+        va[pos] = vals[e];
+      } else {
+        va[pos] += vals[e];
+      }
+    }
+  }
+
+  return CrsMatrix<Kokkos::HostSpace>(row_ptr, col_idx, values, ncols);
+}
+
+} // namespace Impl
+#endif
@@ -0,0 +1,261 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef CRS_FILE_HPP
+#define CRS_FILE_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <generate_matrix.hpp>
+#include <synthetic_matrix.hpp>
+
+// Binary CSR file: a fixed header followed by the row_ptr, col_idx and
+// values arrays, each starting on a page boundary so they can be used in
+// place from a mapping of the file.
+#define CRS_FILE_MAGIC 0x3130305253434b4bull // "KKCSR001"
+#define CRS_FILE_VERSION 1
+#define CRS_FILE_ALIGNMENT 4096
+
+struct CrsFileHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t index_size;
+  uint32_t value_size;
+  int64_t num_rows;
+  int64_t num_cols;
+  int64_t nnz;
+  uint64_t row_ptr_offset;
+  uint64_t col_idx_offset;
+  uint64_t values_offset;
+  uint64_t file_size;
+  uint64_t data_checksum;
+  // Covers every field above.
+  uint64_t header_checksum;
+};
+static_assert(sizeof(CrsFileHeader) == 96, "CrsFileHeader must not be padded");
+
+// A CrsMatrix<HostSpace> whose arrays point into a private mapping of a CSR
+// file. The mapping is released together with the last copy of `mapping`,
+// which must outlive every view taken from `matrix`.
+struct MappedCrsMatrix {
+  CrsMatrix<Kokkos::HostSpace> matrix;
+  std::shared_ptr<void> mapping;
+};
+
+namespace Impl {
+
+inline uint64_t crs_file_align(uint64_t offset) {
+  return (offset + CRS_FILE_ALIGNMENT - 1) / CRS_FILE_ALIGNMENT *
+         CRS_FILE_ALIGNMENT;
+}
+
+inline uint64_t crs_header_checksum(const CrsFileHeader &h) {
+  uint64_t words[sizeof(CrsFileHeader) / 8 - 1];
+  memcpy(words, &h, sizeof(words));
+  uint64_t sum = 0;
+  for (uint64_t w : words)
+    sum = synthetic_hash(sum ^ w);
+  return sum;
+}
+
+// Position dependent but order independent hash of the three arrays, so it
+// can be computed with a plain parallel sum.
+inline uint64_t crs_data_checksum(const CrsMatrix<Kokkos::HostSpace> &A,
+                                  int64_t nnz) {
+  using policy_t = Kokkos::RangePolicy<Kokkos::DefaultHostExecutionSpace>;
+  auto row_ptr = A.row_ptr;
+  auto col_idx = A.col_idx;
+  auto values = A.values;
+  const int64_t nrows = A.num_rows();
+
+  uint64_t sum = 0;
+  Kokkos::parallel_reduce(
+      "CrsChecksum", policy_t(0, nnz > nrows + 1 ? nnz : nrows + 1),
+      [=](const int64_t i, uint64_t &lsum) {
+        if (i <= nrows)
+          lsum += synthetic_hash(uint64_t(row_ptr(i)) ^ (uint64_t(i) << 2));
+        if (i < nnz) {
+          uint64_t bits;
+          memcpy(&bits, &values(i), sizeof(double));
+          lsum += synthetic_hash(uint64_t(col_idx(i)) ^ (uint64_t(i) << 2 | 1));
+          lsum += synthetic_hash(bits ^ (uint64_t(i) << 2 | 2));
+        }
+      },
+      sum);
+  return sum;
+}
+
+// Write A to path. Device matrices are staged through a host mirror.
+// Returns false, after printing the reason, if the file cannot be written.
+template <class MemSpace>
+bool write_crs_file(const char *path, const CrsMatrix<MemSpace> &A) {
+  const int64_t nrows = A.num_rows();
+  int64_t nnz = 0;
+  Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, nrows));
+  CrsMatrix<Kokkos::HostSpace> h_A(
+      Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), A.row_ptr),
+      Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), A.col_idx),
+      Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), A.values),
+      A.num_cols());
+
+  CrsFileHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = CRS_FILE_MAGIC;
+  h.version = CRS_FILE_VERSION;
+  h.header_size = sizeof(CrsFileHeader);
+  h.index_size = sizeof(int64_t);
+  h.value_size = sizeof(double);
+  h.num_rows = nrows;
+  h.num_cols = A.num_cols();
+  h.nnz = nnz;
+  h.row_ptr_offset = crs_file_align(sizeof(CrsFileHeader));
+  h.col_idx_offset =
+      crs_file_align(h.row_ptr_offset + (nrows + 1) * sizeof(int64_t));
+  h.values_offset = crs_file_align(h.col_idx_offset + nnz * sizeof(int64_t));
+  h.file_size = h.values_offset + nnz * sizeof(double);
+  h.data_checksum = crs_data_checksum(h_A, nnz);
+  h.header_checksum = crs_header_checksum(h);
+
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr) {
+    printf("CrsFile: cannot open %s for writing\n", path);
+    return false;
+  }
+  struct Section {
+    uint64_t offset;
+    const void *data;
+    uint64_t bytes;
+  } sections[] = {
+      {0, &h, sizeof(h)},
+      {h.row_ptr_offset, h_A.row_ptr.data(), (nrows + 1) * sizeof(int64_t)},
+      {h.col_idx_offset, h_A.col_idx.data(), nnz * sizeof(int64_t)},
+      {h.values_offset, h_A.values.data(), nnz * sizeof(double)}};
+  bool ok = true;
+  for (const Section &s : sections) {
+    ok = ok && fseek(f, s.offset, SEEK_SET) == 0 &&
+         fwrite(s.data, 1, s.bytes, f) == s.bytes;
+  }
+  ok = fclose(f) == 0 && ok;
+  if (!ok)
+    printf("CrsFile: writing %s failed\n", path);
+  return ok;
+}
+
+// Map path and point a CrsMatrix<HostSpace> at its sections without
+// copying. Pages are faulted in on first touch; verify reads everything
+// once to check the data checksum. Returns false, after printing the
+// reason, if the file is missing, truncated, or was written with other
+// types or by an incompatible version.
+inline bool load_crs_file(const char *path, MappedCrsMatrix &out,
+                          bool verify = true) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("CrsFile: cannot open %s\n", path);
+    return false;
+  }
+  struct stat st;
+  CrsFileHeader h;
+  bool ok = fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(h) &&
+            pread(fd, &h, sizeof(h), 0) == ssize_t(sizeof(h));
+  if (!ok || h.magic != CRS_FILE_MAGIC || h.version != CRS_FILE_VERSION ||
+      h.header_size != sizeof(CrsFileHeader) ||
+      h.header_checksum != crs_header_checksum(h)) {
+    printf("CrsFile: %s is not a version %i CSR file\n", path,
+           CRS_FILE_VERSION);
+    close(fd);
+    return false;
+  }
+  if (h.index_size != sizeof(int64_t) || h.value_size != sizeof(double) ||
+      h.file_size != uint64_t(st.st_size)) {
+    printf("CrsFile: %s has index/value sizes %u/%u and %lu bytes, expected "
+           "%zu/%zu and %lu bytes\n",
+           path, h.index_size, h.value_size, uint64_t(st.st_size),
+           sizeof(int64_t), sizeof(double), h.file_size);
+    close(fd);
+    return false;
+  }
+
+  // Private, writable mapping: the views are non-const, and a stray write
+  // must not reach the file.
+  void *base =
+      mmap(nullptr, h.file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    printf("CrsFile: mmap of %s failed\n", path);
+    return false;
+  }
+  const uint64_t file_size = h.file_size;
+  std::shared_ptr<void> mapping(
+      base, [file_size](void *p) { munmap(p, file_size); });
+
+  char *bytes = static_cast<char *>(base);
+  CrsMatrix<Kokkos::HostSpace> A(
+      Kokkos::View<int64_t *, Kokkos::HostSpace>(
+          reinterpret_cast<int64_t *>(bytes + h.row_ptr_offset),
+          h.num_rows + 1),
+      Kokkos::View<int64_t *, Kokkos::HostSpace>(
+          reinterpret_cast<int64_t *>(bytes + h.col_idx_offset), h.nnz),
+      Kokkos::View<double *, Kokkos::HostSpace>(
+          reinterpret_cast<double *>(bytes + h.values_offset), h.nnz),
+      h.num_cols);
+
+  if (verify && crs_data_checksum(A, h.nnz) != h.data_checksum) {
+    printf("CrsFile: checksum mismatch in %s\n", path);
+    return false;
+  }
+  out.matrix = A;
+  out.mapping = mapping;
+  return true;
+}
+
+} // namespace Impl
+#endif
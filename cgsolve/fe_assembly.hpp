@@ -0,0 +1,262 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef FE_ASSEMBLY_HPP
+#define FE_ASSEMBLY_HPP
+
+#include <omp.h>
+
+#include <synthetic_matrix.hpp>
+
+// Structured mesh of ex x ey x ez trilinear hexahedra. Element (i,j,k) is
+// numbered (k*ey + j)*ex + i and node (i,j,k) is (k*(ey+1) + j)*(ex+1) + i.
+struct HexMesh {
+  int64_t ex, ey, ez;
+
+  KOKKOS_INLINE_FUNCTION
+  int64_t num_elements() const { return ex * ey * ez; }
+  KOKKOS_INLINE_FUNCTION
+  int64_t num_nodes() const { return (ex + 1) * (ey + 1) * (ez + 1); }
+
+  // Local node a of an element sits at offset (a&1, a>>1&1, a>>2).
+  KOKKOS_INLINE_FUNCTION
+  void element_nodes(int64_t e, int64_t nodes[8]) const {
+    const int64_t i = e % ex, j = (e / ex) % ey, k = e / (ex * ey);
+    for (int a = 0; a < 8; ++a)
+      nodes[a] = ((k + (a >> 2)) * (ey + 1) + j + ((a >> 1) & 1)) * (ex + 1) +
+                 i + (a & 1);
+  }
+
+  // Color c holds the elements whose (i,j,k) parities are the bits of c.
+  // Two elements of the same color never share a node.
+  KOKKOS_INLINE_FUNCTION
+  int64_t color_size(int c) const {
+    return ((ex - (c & 1) + 1) / 2) * ((ey - ((c >> 1) & 1) + 1) / 2) *
+           ((ez - (c >> 2) + 1) / 2);
+  }
+  KOKKOS_INLINE_FUNCTION
+  int64_t color_element(int c, int64_t n) const {
+    const int64_t cx = (ex - (c & 1) + 1) / 2;
+    const int64_t cy = (ey - ((c >> 1) & 1) + 1) / 2;
+    const int64_t i = 2 * (n % cx) + (c & 1);
+    const int64_t j = 2 * ((n / cx) % cy) + ((c >> 1) & 1);
+    const int64_t k = 2 * (n / (cx * cy)) + (c >> 2);
+    return (k * ey + j) * ex + i;
+  }
+};
+
+enum AssemblyStrategy {
+  ASSEMBLY_COLORED,
+  ASSEMBLY_ATOMIC,
+  ASSEMBLY_PRIVATE,
+  ASSEMBLY_NUM_STRATEGIES
+};
+
+inline const char *assembly_strategy_name(int s) {
+  static const char *names[] = {"colored", "atomic", "private"};
+  return s >= 0 && s < ASSEMBLY_NUM_STRATEGIES ? names[s] : "unknown";
+}
+
+namespace Impl {
+
+// 27-point node graph of a hex mesh with nx x ny x nz nodes, zero values.
+struct Hex27Rows {
+  int64_t nx, ny, nz;
+
+  template <class F>
+  KOKKOS_INLINE_FUNCTION void operator()(int64_t row, const F &f) const {
+    const int64_t i = row % nx, j = (row / nx) % ny, k = row / (nx * ny);
+    for (int64_t dk = -1; dk <= 1; ++dk)
+      for (int64_t dj = -1; dj <= 1; ++dj)
+        for (int64_t di = -1; di <= 1; ++di)
+          if (i + di >= 0 && i + di < nx && j + dj >= 0 && j + dj < ny &&
+              k + dk >= 0 && k + dk < nz)
+            f(row + (dk * ny + dj) * nx + di, 0.0);
+  }
+};
+
+template <class MemSpace>
+CrsMatrix<MemSpace> generate_hex_graph(const HexMesh &mesh) {
+  return generate_by_rows<MemSpace>(
+      mesh.num_nodes(), mesh.num_nodes(),
+      Hex27Rows{mesh.ex + 1, mesh.ey + 1, mesh.ez + 1});
+}
+
+// Position of col in the sorted column range [begin, end).
+KOKKOS_INLINE_FUNCTION
+int64_t crs_find(const int64_t *col_idx, int64_t begin, int64_t end,
+                 int64_t col) {
+  while (end - begin > 1) {
+    const int64_t mid = (begin + end) / 2;
+    if (col_idx[mid] <= col)
+      begin = mid;
+    else
+      end = mid;
+  }
+  return begin;
+}
+
+// Laplacian stiffness of a unit trilinear hex times coef: 1/3 on the
+// diagonal, 0 between nodes on a common edge, -1/12 across a face or the
+// body diagonal.
+KOKKOS_INLINE_FUNCTION
+double hex_element_entry(double coef, int a, int b) {
+  const int d = a ^ b;
+  const int differ = (d & 1) + ((d >> 1) & 1) + (d >> 2);
+  return coef * (differ == 0 ? 1.0 / 3 : differ == 1 ? 0.0 : -1.0 / 12);
+}
+
+// Hand the 64 entries of element e to add(pos, value), pos being the index
+// into the values of the preallocated graph. The element coefficient in
+// [1, 2) is hashed from e so every strategy sees the same matrix.
+template <class Add>
+KOKKOS_INLINE_FUNCTION void
+hex_assemble_element(const HexMesh &mesh, const int64_t *row_ptr,
+                     const int64_t *col_idx, int64_t e, const Add &add) {
+  int64_t nodes[8];
+  mesh.element_nodes(e, nodes);
+  const double coef = 1.0 + synthetic_uniform(e);
+  for (int a = 0; a < 8; ++a) {
+    const int64_t begin = row_ptr[nodes[a]], end = row_ptr[nodes[a] + 1];
+    for (int b = 0; b < 8; ++b)
+      add(crs_find(col_idx, begin, end, nodes[b]),
+          hex_element_entry(coef, a, b));
+  }
+}
+
+// Assemble into A.values, whose graph comes from generate_hex_graph. Only
+// coloring and atomics are offered here: a private copy of the values per
+// thread does not fit a GPU.
+template <class MemSpace>
+void assemble_hex(const CrsMatrix<MemSpace> &A, const HexMesh &mesh,
+                  int strategy) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  auto row_ptr = A.row_ptr;
+  auto col_idx = A.col_idx;
+  auto values = A.values;
+  Kokkos::deep_copy(values, 0.0);
+  if (strategy == ASSEMBLY_COLORED) {
+    for (int c = 0; c < 8; ++c)
+      Kokkos::parallel_for(
+          "AssembleColored", policy_t(0, mesh.color_size(c)),
+          KOKKOS_LAMBDA(const int64_t n) {
+            hex_assemble_element(
+                mesh, row_ptr.data(), col_idx.data(), mesh.color_element(c, n),
+                [&](int64_t pos, double v) { values(pos) += v; });
+          });
+  } else {
+    Kokkos::parallel_for(
+        "AssembleAtomic", policy_t(0, mesh.num_elements()),
+        KOKKOS_LAMBDA(const int64_t e) {
+          hex_assemble_element(
+              mesh, row_ptr.data(), col_idx.data(), e,
+              [&](int64_t pos, double v) {
+                Kokkos::atomic_add(&values(pos), v);
+              });
+        });
+  }
+}
+
+// Host OpenMP assembly with nthreads threads. The private strategy gives
+// every thread a zeroed copy of the values (nthreads * nnz doubles) and
+// sums the copies afterwards.
+inline void assemble_hex_openmp(const CrsMatrix<Kokkos::HostSpace> &A,
+                                const HexMesh &mesh, int strategy,
+                                int nthreads) {
+  const int64_t *row_ptr = A.row_ptr.data();
+  const int64_t *col_idx = A.col_idx.data();
+  double *values = A.values.data();
+  const int64_t nnz = A.values.extent(0);
+  const int64_t nelements = mesh.num_elements();
+
+  if (strategy == ASSEMBLY_COLORED) {
+#pragma omp parallel for num_threads(nthreads)
+    for (int64_t pos = 0; pos < nnz; ++pos)
+      values[pos] = 0;
+    for (int c = 0; c < 8; ++c) {
+#pragma omp parallel for num_threads(nthreads)
+      for (int64_t n = 0; n < mesh.color_size(c); ++n)
+        hex_assemble_element(mesh, row_ptr, col_idx, mesh.color_element(c, n),
+                             [&](int64_t pos, double v) { values[pos] += v; });
+    }
+  } else if (strategy == ASSEMBLY_ATOMIC) {
+#pragma omp parallel for num_threads(nthreads)
+    for (int64_t pos = 0; pos < nnz; ++pos)
+      values[pos] = 0;
+#pragma omp parallel for num_threads(nthreads)
+    for (int64_t e = 0; e < nelements; ++e)
+      hex_assemble_element(mesh, row_ptr, col_idx, e,
+                           [&](int64_t pos, double v) {
+#pragma omp atomic
+                             values[pos] += v;
+                           });
+  } else {
+    Kokkos::View<double *, Kokkos::HostSpace> copies(
+        Kokkos::view_alloc(Kokkos::WithoutInitializing, "assembly::copies"),
+        nthreads * nnz);
+    double *copy = copies.data();
+#pragma omp parallel num_threads(nthreads)
+    {
+      double *mine = copy + omp_get_thread_num() * nnz;
+      for (int64_t pos = 0; pos < nnz; ++pos)
+        mine[pos] = 0;
+#pragma omp for
+      for (int64_t e = 0; e < nelements; ++e)
+        hex_assemble_element(mesh, row_ptr, col_idx, e,
+                             [&](int64_t pos, double v) { mine[pos] += v; });
+#pragma omp for
+      for (int64_t pos = 0; pos < nnz; ++pos) {
+        double sum = 0;
+        for (int t = 0; t < omp_get_num_threads(); ++t)
+          sum += copy[t * nnz + pos];
+        values[pos] = sum;
+      }
+    }
+  }
+}
+
+} // namespace Impl
+#endif
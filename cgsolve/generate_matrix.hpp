@@ -75,181 +75,217 @@ struct CrsMatrix {
 };
 
 namespace Impl {
-      template<class GO, class S>
-      static void
-      miniFE_get_row (int64_t* rows, S* vals, GO* cols, int64_t startrow,
-                      int64_t endrow, int64_t& row,int64_t o,int64_t nx1,
-                      int64_t c1,int64_t c2, int64_t c3,int64_t val,
-                      int64_t &miniFE_a,int64_t &miniFE_b,int64_t &miniFE_c)
-      {
-        // FIXME (mfh 25 Jun 2014) Seriously, "val27"???  Who writes
-        // code like this???
-
-        bool val27=false;
-        if(c1*c2*c3==27) {
-          val27=true;
+
+// Row (I,J,K) of the miniFE matrix, row = (I*nx1 + J)*nx1 + K, as the
+// original recursive superblock/block/row walk produced it: the first
+// column o, the c1 x c2 x c3 extent of its stencil (2 on a boundary plane,
+// 3 inside), the slot that holds 1.0 on boundary rows, and the position of
+// interior rows in the (nx1-2)^3 interior grid.
+struct MiniFERow {
+  int64_t o;
+  int64_t c1, c2, c3;
+  int64_t val;
+  int64_t a, b, c;
+};
+
+KOKKOS_INLINE_FUNCTION
+MiniFERow miniFE_row(int64_t nx1, int64_t row) {
+  const int64_t I = row / (nx1 * nx1);
+  const int64_t J = (row / nx1) % nx1;
+  const int64_t K = row % nx1;
+
+  MiniFERow r;
+  r.o = (I > 0 ? I - 1 : 0) * nx1 * nx1 + (J > 0 ? J - 1 : 0) * nx1 +
+        (K > 0 ? K - 1 : 0);
+  r.c1 = (I == 0 || I == nx1 - 1) ? 2 : 3;
+  r.c2 = (J == 0 || J == nx1 - 1) ? 2 : 3;
+  r.c3 = (K == 0 || K == nx1 - 1) ? 2 : 3;
+
+  // val1/val2/val3 arguments of the superblock, then of the block.
+  const int64_t s1 = I == 0 ? 0 : 4;
+  const int64_t s2 = I == 0 ? 0 : 2;
+  const int64_t s3 = I == 0 ? 0 : 1;
+  int64_t v1, v2, v3;
+  if (J == 0) {
+    v1 = s1;
+    v2 = s1 + s2 + 1;
+    v3 = s1 + 1;
+  } else if (J == nx1 - 1) {
+    v1 = s1 + 2;
+    v2 = s1 + s2 + 3;
+    v3 = s1 + 3;
+  } else {
+    v1 = s1 + s2 + 3;
+    v2 = s1 + s2 + s2 + s3 + 4;
+    v3 = s1 + s2 + 4;
+  }
+  r.val = K == 0 ? v1 : (K == nx1 - 1 ? v3 : v2);
+
+  r.a = I - 1;
+  r.b = J - 1;
+  r.c = K - 1;
+  return r;
+}
+
+// Calls f(m, col, value) for every store of the original row loop, in the
+// same order. The slot m = i*c2*c3 + j*c2 + k is kept as it was: for
+// c2 != c3 some slots are written twice and others never (those stay
+// col 0, value 0), and with c2 = 3, c3 = 2 the last two stores land in the
+// first two slots of the next row.
+template <class F>
+KOKKOS_INLINE_FUNCTION void miniFE_row_stores(const MiniFERow &r, int64_t nx1,
+                                              const F &f) {
+  const bool val27 = r.c1 * r.c2 * r.c3 == 27;
+  for (int64_t i = 0; i < r.c1; i++)
+    for (int64_t j = 0; j < r.c2; j++)
+      for (int64_t k = 0; k < r.c3; k++) {
+        const int64_t m = i * r.c2 * r.c3 + j * r.c2 + k;
+        const int64_t col = r.o + i * nx1 * nx1 + j * nx1 + k;
+        double v = 0.0;
+        if (val27) {
+          bool doa = ((r.a > 0) && (r.a < nx1 - 3)) ||
+                     ((r.a == 0) && (m / 9 >= 1)) ||
+                     ((r.a == nx1 - 3) && (m / 9 < 2));
+          bool dob = ((r.b > 0) && (r.b < nx1 - 3)) ||
+                     ((r.b == 0) && ((m % 9) / 3 >= 1)) ||
+                     ((r.b == nx1 - 3) && ((m % 9) / 3 < 2));
+          bool doc = ((r.c > 0) && (r.c < nx1 - 3)) ||
+                     ((r.c == 0) && ((m % 3) >= 1)) ||
+                     ((r.c == nx1 - 3) && ((m % 3) < 2));
+          if (doa && dob && doc) {
+            if (m == 13)
+              v = 8.0 / 3.0 / (nx1 - 1);
+            else if (m % 2 == 1)
+              v = -5.0e-1 / 3.0 / (nx1 - 1);
+            else if ((m == 4) || (m == 22) || ((m > 9) && (m < 17)))
+              v = -2.18960e-10 / (nx1 - 1);
+            else
+              v = -2.5e-1 / 3.0 / (nx1 - 1);
+          }
+        } else if (r.val == m) {
+          v = 1.0;
         }
-//printf("%li %li %li\n",c1,c2,c3);
-        if((row>=startrow)&&(row<endrow)) {
-         int64_t offset = rows[row-startrow];
-         rows[row+1-startrow] = offset+c1*c2*c3;
-         for(int64_t i=0; i<c1; i++)
-           for(int64_t j=0;j<c2; j++)
-             for(int64_t k=0;k<c3;k++) {
-               int64_t m = i*c2*c3+j*c2+k;
-               cols[offset+m] = o+i*nx1*nx1+j*nx1+k;
-                 if(val27) {
-                    bool doa = ((miniFE_a>0)&&(miniFE_a<nx1-3)) || ((miniFE_a==0)&&(m/9>=1)) || ((miniFE_a==nx1-3)&&(m/9<2));
-                    bool dob = ((miniFE_b>0)&&(miniFE_b<nx1-3)) || ((miniFE_b==0)&&((m%9)/3>=1)) || ((miniFE_b==nx1-3)&&((m%9)/3<2));
-                    bool doc = ((miniFE_c>0)&&(miniFE_c<nx1-3)) || ((miniFE_c==0)&&((m%3)>=1)) || ((miniFE_c==nx1-3)&&((m%3)<2));
-                    if(doa&&dob&&doc) {
-                       if(m==13)
-                         vals[offset+m] = 8.0/3.0/(nx1-1);
-                       else {
-                         if(m%2==1)
-                           vals[offset+m] = -5.0e-1/3.0/(nx1-1);
-                         else {
-                           if((m==4)||(m==22)|| ((m>9)&&(m<17)))
-                             vals[offset+m] = -2.18960e-10/(nx1-1);
-                           else
-                             vals[offset+m] = -2.5e-1/3.0/(nx1-1);
-                         }
-                       }
-                    } else vals[offset+m] = 0.0;
-                 } else {
-                   if(val==m)
-                     vals[offset+m] = 1.0;
-                   else
-                     vals[offset+m] = 0.0;
-                 }
+        f(m, col, v);
+      }
+}
+
+// Every row is built independently from its grid position, directly in
+// MemSpace. The arrays are sized to the exact nonzero count and the output
+// matches the serial miniFE walk entry for entry, including the num_cols
+// of nx it reported.
+template <class MemSpace = Kokkos::HostSpace>
+CrsMatrix<MemSpace> generate_miniFE_matrix(int64_t nx) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  const int64_t nx1 = nx + 1;
+  const int64_t nrows = nx1 * nx1 * nx1;
+
+  Kokkos::View<int64_t *, MemSpace> row_ptr("generate_MiniFE_Matrix::rowPtr",
+                                            nrows + 1);
+  Kokkos::parallel_for(
+      "MiniFECount", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        const MiniFERow r = miniFE_row(nx1, row);
+        row_ptr(row + 1) = r.c1 * r.c2 * r.c3;
+      });
+
+  int64_t nnz = 0;
+  Kokkos::parallel_scan(
+      "MiniFERowPtr", policy_t(0, nrows + 1),
+      KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+        update += row_ptr(i);
+        if (final)
+          row_ptr(i) = update;
+      },
+      nnz);
+
+  Kokkos::View<int64_t *, MemSpace> col_idx("generate_MiniFE_Matrix::colInd",
+                                            nnz);
+  Kokkos::View<double *, MemSpace> values("generate_MiniFE_Matrix::values",
+                                          nnz);
+  Kokkos::parallel_for(
+      "MiniFEFill", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        const int64_t start = row_ptr(row);
+        const int64_t length = row_ptr(row + 1) - start;
+        // The previous row was written first, so its spill-over is
+        // applied before this row's own stores.
+        if (row > 0) {
+          const MiniFERow p = miniFE_row(nx1, row - 1);
+          const int64_t p_length = p.c1 * p.c2 * p.c3;
+          miniFE_row_stores(p, nx1, [&](int64_t m, int64_t col, double v) {
+            if (m >= p_length && m - p_length < length) {
+              col_idx(start + m - p_length) = col;
+              values(start + m - p_length) = v;
             }
+          });
         }
-         if(c1*c2*c3==27) {
-           miniFE_c++;
-           if(miniFE_c>nx1-3) {miniFE_c=0; miniFE_b++;}
-           if(miniFE_b>nx1-3) {miniFE_b=0; miniFE_a++;}
-         }
-
-         row++;
-       }
-
-       template<class GO, class S>
-       static void miniFE_get_block(int64_t* rows, S* vals, GO* cols,int64_t startrow, int64_t endrow,int64_t& row , int64_t o, int64_t nx1, int64_t c1, int64_t c2,int64_t val1,int64_t val2,int64_t val3,int64_t &miniFE_a,int64_t &miniFE_b,int64_t &miniFE_c) {
-         miniFE_get_row(rows,vals,cols,startrow,endrow,row,o,nx1,c1,c2,2,val1,miniFE_a,miniFE_b,miniFE_c);
-         for(int64_t i=0;i<nx1-2;i++)
-           miniFE_get_row(rows,vals,cols,startrow,endrow,row,o++,nx1,c1,c2,3,val2,miniFE_a,miniFE_b,miniFE_c);
-         miniFE_get_row(rows,vals,cols,startrow,endrow,row,o++,nx1,c1,c2,2,val3,miniFE_a,miniFE_b,miniFE_c);
-       }
-
-       template<class GO, class S>
-       static void miniFE_get_superblock(int64_t* rows, S* vals, GO* cols,int64_t startrow, int64_t endrow,int64_t& row , int64_t o, int64_t nx1, int64_t c1,int64_t val1,int64_t val2,int64_t val3,int64_t &miniFE_a,int64_t &miniFE_b,int64_t &miniFE_c) {
-         miniFE_get_block(rows,vals,cols,startrow,endrow,row,o,nx1,c1,2,val1+0,val1+val2+1,val1+1,miniFE_a,miniFE_b,miniFE_c);
-         for(int64_t i=0;i<nx1-2;i++){
-           miniFE_get_block(rows,vals,cols,startrow,endrow,row,o,nx1,c1,3,val1+val2+3,val1+val2+val2+val3+4,val1+val2+4,miniFE_a,miniFE_b,miniFE_c);
-           o+=nx1;
-         }
-         miniFE_get_block(rows,vals,cols,startrow,endrow,row,o,nx1,c1,2,val1+2,val1+val2+3,val1+3,miniFE_a,miniFE_b,miniFE_c);
-       }
-
-      static CrsMatrix<Kokkos::HostSpace>
-      generate_miniFE_matrix (int nx)
-      {
-        int64_t miniFE_a = 0;
-        int64_t miniFE_b = 0;
-        int64_t miniFE_c = 0;
-
-        const int myRank = 0;
-        const int numRanks = 1;
-        const int rootRank = 0;
-
-        int64_t nx1 = nx+1;
-
-        int nrows_block = 1+nx-1+1;
-        int nrows_superblock = (1+nx-1+1)*nrows_block;
-        int nrows = (1+(nx-1)+1)*nrows_superblock;
-
-        int64_t nnz=0;
-        nnz+=4*(8 + (nx-1)*12 + 8);
-        nnz+=4*(nx-1)*(12 + (nx-1)*18 + 12);
-        nnz+=(nx-1)*(nx-1)*(18 + (nx-1)*27 + 18);
-
-        int64_t dims[3];
-        dims[0] = nrows;
-        dims[1] = nrows;
-        dims[2] = nnz;
-
-        int64_t startrow = (nrows/numRanks) * myRank;
-        int64_t endrow = startrow + (nrows/numRanks);
-        if(endrow > nrows) endrow = nrows;
-
-        Kokkos::View<int64_t*,Kokkos::HostSpace> rowPtr("generate_MiniFE_Matrix::rowPtr",endrow-startrow+1);
-        Kokkos::View<int64_t*,Kokkos::HostSpace> colInd("generate_MiniFE_Matrix::colInd",(endrow-startrow)*27);
-        Kokkos::View<double*,Kokkos::HostSpace> values("generate_MiniFE_Matrix::values",(endrow-startrow)*27);
-
-        int64_t* rows = &rowPtr[0];
-        double* vals = &values[0];
-        int64_t* cols = &colInd[0];
-
-
-        int64_t row = 0;
-        miniFE_get_superblock(rows,vals,cols,startrow,endrow,row,0,nx1,2,0,0,0,miniFE_a,miniFE_b,miniFE_c);
-        for(int64_t i=0;i<nx1-2;i++){
-          miniFE_get_superblock(rows,vals,cols,startrow,endrow,row,i*nx1*nx1,nx1,3,4,2,1,miniFE_a,miniFE_b,miniFE_c);
+        miniFE_row_stores(miniFE_row(nx1, row), nx1,
+                          [&](int64_t m, int64_t col, double v) {
+                            if (m < length) {
+                              col_idx(start + m) = col;
+                              values(start + m) = v;
+                            }
+                          });
+      });
+
+  return CrsMatrix<MemSpace>(row_ptr, col_idx, values, nx);
+}
+
+// Right hand side of the miniFE problem. The serial generator emits
+// (nx+1) superblocks of (nx+1) blocks of (nx+1) entries; the kind of
+// superblock, block and entry follows from the position alone. With
+// nmid = max(nx-3, 0) the superblocks are: zero, edge, nmid interior,
+// edge, zero, and the blocks within a superblock follow the same pattern.
+template <class MemSpace = Kokkos::HostSpace>
+Kokkos::View<double *, MemSpace> generate_miniFE_vector(int64_t nx) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  const int64_t numRows = (nx + 1) * (nx + 1) * (nx + 1);
+  const int64_t nmid = nx > 3 ? nx - 3 : 0;
+  // Entries per block and per superblock of the serial walk; for nx < 3
+  // these are not nx+1 and (nx+1)^2, the walk is then cut off at numRows.
+  const int64_t block = 3 + (nx > 2 ? nx - 2 : 0);
+  const int64_t superblock = (4 + nmid) * block;
+
+  Kokkos::View<double *, MemSpace> X("X", numRows);
+  Kokkos::parallel_for(
+      "MiniFEVector", policy_t(0, numRows), KOKKOS_LAMBDA(const int64_t i) {
+        const int64_t I = i / superblock;
+        const int64_t J = (i % superblock) / block;
+        const int64_t K = i % block;
+
+        double sa = 0.0, sb = 0.0, sc = 0.0;
+        if (I == 1 || I == 2 + nmid) {
+          sa = 1.0;
+          sb = 5.0 / 12;
+          sc = 8.0 / 12;
+        } else if (I > 1 && I < 2 + nmid) {
+          sa = 1.0;
+          sb = 8.0 / 12;
+          sc = 1.0;
         }
-        miniFE_get_superblock(rows,vals,cols,startrow,endrow,row,(nx1-2)*nx1*nx1,nx1,2,4,2,1,miniFE_a,miniFE_b,miniFE_c);
 
-        CrsMatrix<Kokkos::HostSpace> matrix(rowPtr,colInd,values,nx);
-        return matrix;
-      }
+        double a = 0.0, b = 0.0;
+        if (J == 1 || J == 2 + nmid) {
+          a = sa;
+          b = sb;
+        } else if (J > 1 && J < 2 + nmid) {
+          a = sa;
+          b = sc;
+        }
 
-       template<class S>
-       static void miniFE_vector_generate_block(S* vec, int nx, S a, S b, int& count,int start,int end){
-         if((count>=start) && (count<end))
-         vec[count++ - start] = 0;
-         for(int i=0; i<nx-2; i++)
-           if((count>=start) && (count<end))
-             vec[count++ - start] = a/nx/nx/nx;
-         if((count>=start) && (count<end))
-         vec[count++ - start] = a/nx/nx/nx + b/nx;
-         if((count>=start) && (count<end))
-         vec[count++ - start] = 1;
-       }
-
-       template<class S>
-       static void miniFE_vector_generate_superblock(S* vec, int nx, S a,S b,S c, int& count,int start,int end){
-         miniFE_vector_generate_block(vec,nx,0.0,0.0,count,start,end);
-         miniFE_vector_generate_block(vec,nx,a,b,count,start,end);
-         for(int i = 0;i<nx-3;i++)
-           miniFE_vector_generate_block(vec,nx,a,c,count,start,end);
-         miniFE_vector_generate_block(vec,nx,a,b,count,start,end);
-         miniFE_vector_generate_block(vec,nx,0.0,0.0,count,start,end);
-       }
-
-       Kokkos::View<double*, Kokkos::HostSpace>
-       generate_miniFE_vector( int64_t nx) {
-
-         int my_rank = 0;
-         int num_ranks = 1;
-
-         const int64_t numRows = (nx+1)*(nx+1)*(nx+1);
-
-         int64_t start = numRows/num_ranks * my_rank;
-         int64_t end = start + numRows/num_ranks;
-         if(end > numRows) end = numRows;
-
-         // Make a multivector X owned entirely by Proc 0.
-         Kokkos::View<double*, Kokkos::HostSpace> X("X_host",numRows);
-         double* vec = X.data();
-         int count = 0;
-         miniFE_vector_generate_superblock(vec,nx,0.0,0.0,0.0,count,start,end);
-         miniFE_vector_generate_superblock(vec,nx,1.0,5.0/12,8.0/12,count,start,end);
-         for(int i = 0; i<nx-3; i++)
-           miniFE_vector_generate_superblock(vec,nx,1.0,8.0/12,1.0,count,start,end);
-         miniFE_vector_generate_superblock(vec,nx,1.0,5.0/12,8.0/12,count,start,end);
-         miniFE_vector_generate_superblock(vec,nx,0.0,0.0,0.0,count,start,end);
-
-         return X;
-       }
+        if (K == 0)
+          X(i) = 0;
+        else if (K < block - 2)
+          X(i) = a / nx / nx / nx;
+        else if (K == block - 2)
+          X(i) = a / nx / nx / nx + b / nx;
+        else
+          X(i) = 1;
+      });
+  return X;
+}
 
 }
 #endif
@@ -0,0 +1,139 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef INTERLEAVED_MATRIX_HPP
+#define INTERLEAVED_MATRIX_HPP
+
+#include <cstring>
+#include <generate_matrix.hpp>
+
+// 16 byte entry: the 64-bit column index next to its value.
+struct CrsEntry16 {
+  int64_t col;
+  double val;
+
+  KOKKOS_INLINE_FUNCTION
+  int64_t column() const { return col; }
+  KOKKOS_INLINE_FUNCTION
+  double value() const { return val; }
+  KOKKOS_INLINE_FUNCTION
+  void set(int64_t c, double v) {
+    col = c;
+    val = v;
+  }
+};
+
+// 12 byte entry: a 32-bit column index and the value stored as two 32-bit
+// words, so the struct only needs 4 byte alignment and packs tightly.
+struct CrsEntry12 {
+  int32_t col;
+  uint32_t val_lo, val_hi;
+
+  KOKKOS_INLINE_FUNCTION
+  int64_t column() const { return col; }
+  KOKKOS_INLINE_FUNCTION
+  double value() const {
+    uint64_t bits = (uint64_t(val_hi) << 32) | val_lo;
+    double v;
+    memcpy(&v, &bits, sizeof(double));
+    return v;
+  }
+  KOKKOS_INLINE_FUNCTION
+  void set(int64_t c, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(double));
+    col = int32_t(c);
+    val_lo = uint32_t(bits);
+    val_hi = uint32_t(bits >> 32);
+  }
+};
+
+// CSR matrix whose column indices and values are interleaved in a single
+// array of Entry, one memory stream per nonzero instead of two.
+template <class Entry, class MemSpace> struct InterleavedCrsMatrix {
+  Kokkos::View<int64_t *, MemSpace> row_ptr;
+  Kokkos::View<Entry *, MemSpace> entries;
+
+  int64_t _num_cols;
+  KOKKOS_INLINE_FUNCTION
+  int64_t num_rows() const { return row_ptr.extent(0) - 1; }
+  KOKKOS_INLINE_FUNCTION
+  int64_t num_cols() const { return _num_cols; }
+  KOKKOS_INLINE_FUNCTION
+  int64_t nnz() const { return entries.extent(0); }
+
+  InterleavedCrsMatrix() = default;
+
+  InterleavedCrsMatrix(Kokkos::View<int64_t *, MemSpace> row_ptr_,
+                       Kokkos::View<Entry *, MemSpace> entries_,
+                       int64_t num_cols_)
+      : row_ptr(row_ptr_), entries(entries_), _num_cols(num_cols_) {}
+};
+
+namespace Impl {
+
+// Interleaved copy of A. row_ptr is shared with A.
+template <class Entry, class MemSpace>
+InterleavedCrsMatrix<Entry, MemSpace>
+interleave(const CrsMatrix<MemSpace> &A) {
+  using ExecSpace = typename MemSpace::execution_space;
+
+  int64_t nnz = 0;
+  Kokkos::deep_copy(nnz, Kokkos::subview(A.row_ptr, A.num_rows()));
+  auto col_idx = A.col_idx;
+  auto values = A.values;
+
+  Kokkos::View<Entry *, MemSpace> entries("interleaved::entries", nnz);
+  Kokkos::parallel_for(
+      "Interleave", Kokkos::RangePolicy<ExecSpace>(0, nnz),
+      KOKKOS_LAMBDA(const int64_t i) {
+        entries(i).set(col_idx(i), values(i));
+      });
+
+  return InterleavedCrsMatrix<Entry, MemSpace>(A.row_ptr, entries,
+                                               A.num_cols());
+}
+
+} // namespace Impl
+#endif
@@ -49,16 +49,89 @@
 
 #include<generate_matrix.hpp>
 #include <cgsolve.hpp>
+#include <cstring>
 
 int main(int argc, char* argv[]) {
   Kokkos::initialize(argc,argv);
+  // Non-zero when a regression check failed.
+  int status = 0;
   {
     int N = argc>1?atoi(argv[1]):100;
     int max_iter = argc>2?atoi(argv[2]):200;
     double tolerance = argc>3?atoi(argv[3]):1e-7;
+    bool symmetric = false;
+    bool merge = false;
+    bool scratch = false;
+    bool interleaved = false;
+    bool rcm = false;
+    bool automatic = false;
+    bool coo = false;
+    bool transpose = false;
+    bool spgemm = false;
+    bool suite = false;
+    bool assembly = false;
+    bool tune = false;
+    const char *matrix_file = nullptr;
+    const char *mtx_file = nullptr;
+    for (int i = 4; i < argc; ++i) {
+      if (strcmp(argv[i], "--sym") == 0)
+        symmetric = true;
+      else if (strcmp(argv[i], "--merge") == 0)
+        merge = true;
+      else if (strcmp(argv[i], "--scratch") == 0)
+        scratch = true;
+      else if (strcmp(argv[i], "--interleaved") == 0)
+        interleaved = true;
+      else if (strcmp(argv[i], "--rcm") == 0)
+        rcm = true;
+      else if (strcmp(argv[i], "--auto") == 0)
+        automatic = true;
+      else if (strcmp(argv[i], "--coo") == 0)
+        coo = true;
+      else if (strcmp(argv[i], "--transpose") == 0)
+        transpose = true;
+      else if (strcmp(argv[i], "--spgemm") == 0)
+        spgemm = true;
+      else if (strcmp(argv[i], "--suite") == 0)
+        suite = true;
+      else if (strcmp(argv[i], "--assembly") == 0)
+        assembly = true;
+      else if (strcmp(argv[i], "--tune") == 0)
+        tune = true;
+      else if (strcmp(argv[i], "--matrix-file") == 0 && i + 1 < argc)
+        matrix_file = argv[++i];
+      else if (strcmp(argv[i], "--mtx") == 0 && i + 1 < argc)
+        mtx_file = argv[++i];
+    }
 
-    cgsolve obj(N, max_iter, tolerance);
-    obj.run_test();
+    cgsolve obj(N, max_iter, tolerance, symmetric, matrix_file,
+                mtx_file);
+    // Cached SpMV launches are loaded on every run, --tune searches on a
+    // miss.
+    obj.tune_spmv_launch(5, tune);
+    if (merge)
+      obj.run_merge_spmv_test(10);
+    else if (scratch)
+      obj.run_scratch_spmv_test(10);
+    else if (interleaved)
+      obj.run_interleaved_spmv_test(10);
+    else if (rcm)
+      obj.run_rcm_test(10);
+    else if (automatic)
+      obj.run_auto_test();
+    else if (coo)
+      obj.run_coo_test(5);
+    else if (transpose)
+      obj.run_transpose_test(10);
+    else if (spgemm)
+      obj.run_spgemm_test(3);
+    else if (suite)
+      status = obj.run_spmv_suite(10) > 0 ? 1 : 0;
+    else if (assembly)
+      obj.run_assembly_test(5);
+    else
+      obj.run_test();
   }
   Kokkos::finalize();
+  return status;
 }
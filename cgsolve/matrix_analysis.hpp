@@ -0,0 +1,306 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef MATRIX_ANALYSIS_HPP
+#define MATRIX_ANALYSIS_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <generate_matrix.hpp>
+#include <interleaved_matrix.hpp>
+#include <reorder.hpp>
+#include <synthetic_matrix.hpp>
+
+// Row lengths are binned by bit width: bucket 0 holds empty rows, bucket b
+// rows with 2^(b-1) <= length < 2^b.
+#define ROW_LENGTH_BUCKETS 32
+// Distinct values are counted exactly up to this many, beyond that the
+// matrix is reported as "many".
+#define DISTINCT_VALUE_CAP 1024
+
+// SpMV kernels the selector chooses between.
+enum SpmvFormat {
+  SPMV_CSR,
+  SPMV_CSR_MERGE,
+  SPMV_CSR_SCRATCH,
+  SPMV_INTERLEAVED,
+  SPMV_NUM_FORMATS
+};
+
+inline const char *spmv_format_name(int format) {
+  static const char *names[] = {"csr", "merge", "scratch", "interleaved"};
+  return format >= 0 && format < SPMV_NUM_FORMATS ? names[format] : "unknown";
+}
+
+inline int spmv_format_from_name(const char *name) {
+  for (int f = 0; f < SPMV_NUM_FORMATS; ++f)
+    if (strcmp(name, spmv_format_name(f)) == 0)
+      return f;
+  return -1;
+}
+
+struct MatrixStats {
+  int64_t num_rows = 0;
+  int64_t nnz = 0;
+  int64_t min_row_length = 0;
+  int64_t max_row_length = 0;
+  int64_t row_length_histogram[ROW_LENGTH_BUCKETS] = {};
+  int64_t bandwidth = 0;
+  int64_t profile = 0;
+  // Number of occupied diagonals (col - row offsets) and the fraction of a
+  // DIA layout with that many diagonals that would hold nonzeros.
+  int64_t num_diagonals = 0;
+  double diagonal_fill = 0;
+  // -1 if there are more than DISTINCT_VALUE_CAP distinct values.
+  int64_t distinct_values = 0;
+  // Hash of the sparsity pattern and of the statistics above.
+  uint64_t fingerprint = 0;
+
+  void print(const char *name) const {
+    printf("%s: rows %li nnz %li row length min %li avg %.1lf max %li\n",
+           name, num_rows, nnz, min_row_length,
+           num_rows > 0 ? double(nnz) / num_rows : 0., max_row_length);
+    for (int b = 0; b < ROW_LENGTH_BUCKETS; ++b)
+      if (row_length_histogram[b] > 0)
+        printf("%s:   rows of length [%li, %li): %li\n", name,
+               b == 0 ? 0l : int64_t(1) << (b - 1), int64_t(1) << b,
+               row_length_histogram[b]);
+    printf("%s: bandwidth %li profile %li diagonals %li (DIA fill %lf)\n",
+           name, bandwidth, profile, num_diagonals, diagonal_fill);
+    if (distinct_values < 0)
+      printf("%s: distinct values > %i fingerprint %016lx\n", name,
+             DISTINCT_VALUE_CAP, fingerprint);
+    else
+      printf("%s: distinct values %li fingerprint %016lx\n", name,
+             distinct_values, fingerprint);
+  }
+};
+
+// A CrsMatrix together with the SpMV kernel chosen for it on each backend.
+// The interleaved copy is only built when one of the backends uses it.
+template <class MemSpace> struct TunedCrsMatrix {
+  CrsMatrix<MemSpace> csr;
+  InterleavedCrsMatrix<CrsEntry16, MemSpace> interleaved;
+  int format_kk = SPMV_CSR;
+  int format_ompt = SPMV_CSR;
+
+  KOKKOS_INLINE_FUNCTION
+  int64_t num_rows() const { return csr.num_rows(); }
+};
+
+// Decisions of earlier runs, one "<fingerprint> <backend> <format>" line
+// each. New decisions are appended, so the file can be shared between runs
+// and deleted to force re-timing.
+struct SpmvFormatCache {
+  std::string path;
+  std::map<std::string, int> entries;
+
+  SpmvFormatCache(const char *path_) : path(path_) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+      return;
+    char key[64], backend[64], format[64];
+    while (fscanf(f, "%63s %63s %63s", key, backend, format) == 3) {
+      int fmt = spmv_format_from_name(format);
+      if (fmt >= 0)
+        entries[std::string(key) + " " + backend] = fmt;
+    }
+    fclose(f);
+  }
+
+  static std::string key(uint64_t fingerprint, const char *backend) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%016lx %s", fingerprint, backend);
+    return buf;
+  }
+
+  int lookup(uint64_t fingerprint, const char *backend) const {
+    auto it = entries.find(key(fingerprint, backend));
+    return it == entries.end() ? -1 : it->second;
+  }
+
+  void store(uint64_t fingerprint, const char *backend, int format) {
+    entries[key(fingerprint, backend)] = format;
+    FILE *f = fopen(path.c_str(), "a");
+    if (f == nullptr)
+      return;
+    fprintf(f, "%s %s\n", key(fingerprint, backend).c_str(),
+            spmv_format_name(format));
+    fclose(f);
+  }
+};
+
+namespace Impl {
+
+KOKKOS_INLINE_FUNCTION
+int row_length_bucket(int64_t length) {
+  int b = 0;
+  while (length > 0 && b < ROW_LENGTH_BUCKETS - 1) {
+    length >>= 1;
+    ++b;
+  }
+  return b;
+}
+
+// All statistics are computed in the execution space of MemSpace; only the
+// scalar results come back to the host.
+template <class MemSpace>
+MatrixStats analyze_matrix(const CrsMatrix<MemSpace> &A) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  MatrixStats stats;
+  const int64_t nrows = A.num_rows();
+  auto row_ptr = A.row_ptr;
+  auto col_idx = A.col_idx;
+  auto values = A.values;
+  stats.num_rows = nrows;
+  Kokkos::deep_copy(stats.nnz, Kokkos::subview(row_ptr, nrows));
+
+  Kokkos::View<int64_t[ROW_LENGTH_BUCKETS], MemSpace> histogram(
+      "stats::histogram");
+  Kokkos::MinMaxScalar<int64_t> lengths;
+  Kokkos::parallel_reduce(
+      "RowLengths", policy_t(0, nrows),
+      KOKKOS_LAMBDA(const int64_t row, Kokkos::MinMaxScalar<int64_t> &lm) {
+        const int64_t length = row_ptr(row + 1) - row_ptr(row);
+        Kokkos::atomic_increment(&histogram(row_length_bucket(length)));
+        if (length < lm.min_val)
+          lm.min_val = length;
+        if (length > lm.max_val)
+          lm.max_val = length;
+      },
+      Kokkos::MinMax<int64_t>(lengths));
+  stats.min_row_length = lengths.min_val;
+  stats.max_row_length = lengths.max_val;
+  auto h_histogram = Kokkos::create_mirror_view(histogram);
+  Kokkos::deep_copy(h_histogram, histogram);
+  for (int b = 0; b < ROW_LENGTH_BUCKETS; ++b)
+    stats.row_length_histogram[b] = h_histogram(b);
+
+  bandwidth_profile(A, stats.bandwidth, stats.profile);
+
+  // Diagonal d = col - row is stored at offset d + nrows - 1. Concurrent
+  // writers all store 1, so no atomics are needed.
+  Kokkos::View<int32_t *, MemSpace> occupied("stats::diagonals",
+                                             nrows > 0 ? 2 * nrows - 1 : 0);
+  Kokkos::parallel_for(
+      "Diagonals", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        for (int64_t i = row_ptr(row); i < row_ptr(row + 1); ++i)
+          occupied(col_idx(i) - row + nrows - 1) = 1;
+      });
+  Kokkos::parallel_reduce(
+      "CountDiagonals", policy_t(0, occupied.extent(0)),
+      KOKKOS_LAMBDA(const int64_t d, int64_t &count) { count += occupied(d); },
+      stats.num_diagonals);
+  if (stats.num_diagonals > 0)
+    stats.diagonal_fill =
+        double(stats.nnz) / (double(stats.num_diagonals) * nrows);
+
+  // Open addressing set of value bit patterns. The table is twice the cap
+  // so probe sequences stay short until the cap is reached; after that
+  // inserts stop and the count is only used to flag the overflow.
+  const uint64_t empty = ~uint64_t(0);
+  const int64_t table_size = 2 * DISTINCT_VALUE_CAP;
+  Kokkos::View<uint64_t *, MemSpace> table("stats::values", table_size);
+  Kokkos::View<int64_t, MemSpace> distinct("stats::distinct");
+  Kokkos::deep_copy(table, empty);
+  Kokkos::parallel_for(
+      "DistinctValues", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        for (int64_t i = row_ptr(row); i < row_ptr(row + 1); ++i) {
+          if (distinct() > DISTINCT_VALUE_CAP)
+            return;
+          const double v = values(i);
+          uint64_t bits;
+          memcpy(&bits, &v, sizeof(double));
+          if (bits == empty)
+            continue;
+          int64_t slot = synthetic_hash(bits) % table_size;
+          for (int64_t probe = 0; probe < table_size; ++probe) {
+            const uint64_t old =
+                Kokkos::atomic_compare_exchange(&table(slot), empty, bits);
+            if (old == empty) {
+              Kokkos::atomic_increment(&distinct());
+              break;
+            }
+            if (old == bits)
+              break;
+            slot = slot + 1 < table_size ? slot + 1 : 0;
+          }
+        }
+      });
+  Kokkos::deep_copy(stats.distinct_values, distinct);
+  if (stats.distinct_values > DISTINCT_VALUE_CAP)
+    stats.distinct_values = -1;
+
+  // Order independent hash of the (row, col) pairs, so it does not depend
+  // on how the reduction is split.
+  uint64_t pattern = 0;
+  Kokkos::parallel_reduce(
+      "PatternHash", policy_t(0, nrows),
+      KOKKOS_LAMBDA(const int64_t row, uint64_t &lsum) {
+        for (int64_t i = row_ptr(row); i < row_ptr(row + 1); ++i)
+          lsum += synthetic_hash(uint64_t(row) * 0x100000001b3ull ^
+                                 uint64_t(col_idx(i)));
+      },
+      pattern);
+
+  uint64_t h = synthetic_hash(pattern);
+  const int64_t fields[] = {stats.num_rows,       stats.nnz,
+                            stats.min_row_length, stats.max_row_length,
+                            stats.bandwidth,      stats.num_diagonals,
+                            stats.distinct_values};
+  for (int64_t v : fields)
+    h = synthetic_hash(h ^ uint64_t(v));
+  for (int b = 0; b < ROW_LENGTH_BUCKETS; ++b)
+    h = synthetic_hash(h ^ uint64_t(stats.row_length_histogram[b]));
+  stats.fingerprint = h;
+  return stats;
+}
+
+} // namespace Impl
+#endif
@@ -0,0 +1,322 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef MATRIX_MARKET_HPP
+#define MATRIX_MARKET_HPP
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <coo_builder.hpp>
+#include <generate_matrix.hpp>
+
+// Bytes read by one pread, and chunks parsed per host thread; more chunks
+// than threads evens out chunks with many comment or long lines.
+#define MTX_READ_BLOCK (64 << 20)
+#define MTX_CHUNKS_PER_THREAD 8
+
+namespace Impl {
+
+KOKKOS_INLINE_FUNCTION
+bool mtx_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Parses an unsigned integer at p and advances p past it. Leading blanks
+// are skipped; returns false if there is no digit.
+inline bool mtx_parse_index(const char *&p, int64_t &v) {
+  while (mtx_space(*p))
+    ++p;
+  if (*p < '0' || *p > '9')
+    return false;
+  v = 0;
+  while (*p >= '0' && *p <= '9')
+    v = 10 * v + (*p++ - '0');
+  return true;
+}
+
+// Start of the first line at or after offset, without going past end.
+inline int64_t mtx_line_start(const char *buf, int64_t offset, int64_t begin,
+                              int64_t end) {
+  if (offset <= begin)
+    return begin;
+  if (buf[offset - 1] == '\n')
+    return offset;
+  const void *nl = memchr(buf + offset, '\n', end - offset);
+  return nl == nullptr ? end : static_cast<const char *>(nl) - buf + 1;
+}
+
+// Data lines are the lines holding anything but blanks and comments.
+inline bool mtx_data_line(const char *p) {
+  while (mtx_space(*p))
+    ++p;
+  return *p != '\n' && *p != '\0' && *p != '%';
+}
+
+// Read a Matrix Market coordinate file (real, integer or pattern; general,
+// symmetric or skew-symmetric) into a CrsMatrix with sorted rows and
+// duplicates summed. The file is read with parallel preads, cut into chunks
+// at line boundaries, and every chunk is counted and then parsed by one
+// host thread; symmetric storage is expanded to both triangles. Returns
+// false, after printing the reason, on any error.
+inline bool read_matrix_market(const char *path,
+                               CrsMatrix<Kokkos::HostSpace> &A) {
+  using policy_t = Kokkos::RangePolicy<Kokkos::DefaultHostExecutionSpace>;
+  Kokkos::Timer timer;
+
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    printf("MatrixMarket: cannot open %s\n", path);
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  const int64_t size = st.st_size;
+  Kokkos::View<char *, Kokkos::HostSpace> buffer(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "mtx::buffer"),
+      size + 1);
+  char *buf = buffer.data();
+  int64_t read_errors = 0;
+  Kokkos::parallel_reduce(
+      "MtxRead",
+      policy_t(0, (size + MTX_READ_BLOCK - 1) / MTX_READ_BLOCK),
+      [=](const int64_t b, int64_t &errors) {
+        int64_t pos = b * MTX_READ_BLOCK;
+        const int64_t end =
+            pos + MTX_READ_BLOCK < size ? pos + MTX_READ_BLOCK : size;
+        while (pos < end) {
+          ssize_t n = pread(fd, buf + pos, end - pos, pos);
+          if (n <= 0) {
+            ++errors;
+            return;
+          }
+          pos += n;
+        }
+      },
+      read_errors);
+  close(fd);
+  buf[size] = '\0';
+  if (read_errors > 0) {
+    printf("MatrixMarket: reading %s failed\n", path);
+    return false;
+  }
+  const double t_read = timer.seconds();
+  timer.reset();
+
+  // Banner, comments and the size line are parsed serially.
+  char object[32] = "", format[32] = "", field[32] = "", symmetry[32] = "";
+  if (sscanf(buf, "%%%%MatrixMarket %31s %31s %31s %31s", object, format,
+             field, symmetry) != 4) {
+    printf("MatrixMarket: %s has no MatrixMarket banner\n", path);
+    return false;
+  }
+  for (char *s : {object, format, field, symmetry})
+    for (; *s; ++s)
+      *s = tolower(*s);
+  const bool pattern = strcmp(field, "pattern") == 0;
+  const bool symmetric = strcmp(symmetry, "symmetric") == 0;
+  const bool skew = strcmp(symmetry, "skew-symmetric") == 0;
+  if (strcmp(object, "matrix") != 0 || strcmp(format, "coordinate") != 0 ||
+      !(pattern || strcmp(field, "real") == 0 ||
+        strcmp(field, "double") == 0 || strcmp(field, "integer") == 0) ||
+      !(symmetric || skew || strcmp(symmetry, "general") == 0)) {
+    printf("MatrixMarket: %s is '%s %s %s %s', only real, integer or "
+           "pattern coordinate matrices are supported\n",
+           path, object, format, field, symmetry);
+    return false;
+  }
+
+  int64_t pos = mtx_line_start(buf, 1, 0, size);
+  while (pos < size && !mtx_data_line(buf + pos))
+    pos = mtx_line_start(buf, pos + 1, 0, size);
+  const char *p = buf + pos;
+  int64_t nrows, ncols, nz;
+  if (!mtx_parse_index(p, nrows) || !mtx_parse_index(p, ncols) ||
+      !mtx_parse_index(p, nz)) {
+    printf("MatrixMarket: %s has no size line\n", path);
+    return false;
+  }
+  const int64_t body = mtx_line_start(buf, p - buf, 0, size);
+
+  // Chunk c covers [chunk(c), chunk(c+1)), both on line starts.
+  const int64_t nchunks =
+      Kokkos::DefaultHostExecutionSpace().concurrency() * MTX_CHUNKS_PER_THREAD;
+  Kokkos::View<int64_t *, Kokkos::HostSpace> chunk("mtx::chunk", nchunks + 1);
+  Kokkos::View<int64_t *, Kokkos::HostSpace> offset("mtx::offset",
+                                                    nchunks + 1);
+  Kokkos::parallel_for(
+      "MtxChunks", policy_t(0, nchunks + 1), [=](const int64_t c) {
+        chunk(c) = mtx_line_start(buf, body + (size - body) * c / nchunks,
+                                  body, size);
+      });
+  Kokkos::parallel_for(
+      "MtxCount", policy_t(0, nchunks), [=](const int64_t c) {
+        int64_t lines = 0;
+        for (int64_t l = chunk(c); l < chunk(c + 1);
+             l = mtx_line_start(buf, l + 1, body, chunk(c + 1)))
+          if (mtx_data_line(buf + l))
+            ++lines;
+        offset(c) = lines;
+      });
+  int64_t entries = 0;
+  Kokkos::parallel_scan(
+      "MtxOffsets", policy_t(0, nchunks + 1),
+      [=](const int64_t c, int64_t &update, const bool final) {
+        const int64_t lines = c < nchunks ? offset(c) : 0;
+        if (final)
+          offset(c) = update;
+        update += lines;
+      },
+      entries);
+  if (entries != nz) {
+    printf("MatrixMarket: %s declares %li entries but holds %li\n", path, nz,
+           entries);
+    return false;
+  }
+
+  Kokkos::View<int64_t *, Kokkos::HostSpace> rows(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "mtx::rows"), nz);
+  Kokkos::View<int64_t *, Kokkos::HostSpace> cols(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "mtx::cols"), nz);
+  Kokkos::View<double *, Kokkos::HostSpace> vals(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "mtx::vals"), nz);
+  int64_t bad = 0;
+  Kokkos::parallel_reduce(
+      "MtxParse", policy_t(0, nchunks),
+      [=](const int64_t c, int64_t &lbad) {
+        int64_t e = offset(c);
+        for (int64_t l = chunk(c); l < chunk(c + 1);
+             l = mtx_line_start(buf, l + 1, body, chunk(c + 1))) {
+          if (!mtx_data_line(buf + l))
+            continue;
+          const char *q = buf + l;
+          int64_t i, j;
+          double v = 1.0;
+          if (!mtx_parse_index(q, i) || !mtx_parse_index(q, j) || i < 1 ||
+              i > nrows || j < 1 || j > ncols) {
+            ++lbad;
+            i = j = 1;
+          } else if (!pattern) {
+            // strtod would skip the newline and read the next line.
+            while (mtx_space(*q))
+              ++q;
+            char *v_end;
+            v = strtod(q, &v_end);
+            if (*q == '\n' || v_end == q)
+              ++lbad;
+          }
+          rows(e) = i - 1;
+          cols(e) = j - 1;
+          vals(e) = v;
+          ++e;
+        }
+      },
+      bad);
+  if (bad > 0) {
+    printf("MatrixMarket: %s has %li malformed entries\n", path, bad);
+    return false;
+  }
+  const double t_parse = timer.seconds();
+  timer.reset();
+
+  // Symmetric storage: append the mirror of every off-diagonal entry.
+  const bool expand = symmetric || skew;
+  int64_t mirrored = 0;
+  if (expand) {
+    Kokkos::parallel_reduce(
+        "MtxMirrored", policy_t(0, nz),
+        [=](const int64_t e, int64_t &count) {
+          if (rows(e) != cols(e))
+            ++count;
+        },
+        mirrored);
+    Kokkos::View<int64_t *, Kokkos::HostSpace> all_rows(
+        Kokkos::view_alloc(Kokkos::WithoutInitializing, "mtx::rows"),
+        nz + mirrored);
+    Kokkos::View<int64_t *, Kokkos::HostSpace> all_cols(
+        Kokkos::view_alloc(Kokkos::WithoutInitializing, "mtx::cols"),
+        nz + mirrored);
+    Kokkos::View<double *, Kokkos::HostSpace> all_vals(
+        Kokkos::view_alloc(Kokkos::WithoutInitializing, "mtx::vals"),
+        nz + mirrored);
+    Kokkos::parallel_scan(
+        "MtxMirror", policy_t(0, nz),
+        [=](const int64_t e, int64_t &update, const bool final) {
+          const bool off_diagonal = rows(e) != cols(e);
+          if (final) {
+            all_rows(e) = rows(e);
+            all_cols(e) = cols(e);
+            all_vals(e) = vals(e);
+            if (off_diagonal) {
+              all_rows(nz + update) = cols(e);
+              all_cols(nz + update) = rows(e);
+              all_vals(nz + update) = skew ? -vals(e) : vals(e);
+            }
+          }
+          if (off_diagonal)
+            ++update;
+        });
+    rows = all_rows;
+    cols = all_cols;
+    vals = all_vals;
+  }
+  A = coo_to_crs<Kokkos::HostSpace>(nrows, ncols, rows, cols, vals);
+  const double t_build = timer.seconds();
+
+  const double MB = size / 1024.0 / 1024.0;
+  printf("MatrixMarket: %s %li x %li, %li entries (%li stored) %s %s\n", path,
+         nrows, ncols, A.row_ptr(nrows), nz, field, symmetry);
+  printf("MatrixMarket: %.1lf MB read %e s (%.1lf MB/s) parsed %e s (%.1lf "
+         "MB/s) CSR built %e s, %li chunks\n",
+         MB, t_read, MB / t_read, t_parse, MB / t_parse, t_build, nchunks);
+  return true;
+}
+
+} // namespace Impl
+#endif
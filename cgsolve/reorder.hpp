@@ -0,0 +1,347 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef REORDER_HPP
+#define REORDER_HPP
+
+#include <generate_matrix.hpp>
+
+// Bandwidth-reducing reordering of a structurally symmetric CrsMatrix.
+// A permutation perm maps new index -> old index: row i of the reordered
+// matrix is row perm(i) of the original one.
+
+namespace Impl {
+
+// Bandwidth max|i-j| and lower profile sum_i (i - min_j a_ij) of A.
+template <class MemSpace>
+void bandwidth_profile(const CrsMatrix<MemSpace> &A, int64_t &bandwidth,
+                       int64_t &profile) {
+  using policy_t = Kokkos::RangePolicy<typename MemSpace::execution_space>;
+  auto row_ptr = A.row_ptr;
+  auto col_idx = A.col_idx;
+
+  Kokkos::parallel_reduce(
+      "Bandwidth", policy_t(0, A.num_rows()),
+      KOKKOS_LAMBDA(const int64_t row, int64_t &lmax) {
+        for (int64_t i = row_ptr(row); i < row_ptr(row + 1); ++i) {
+          const int64_t d =
+              col_idx(i) > row ? col_idx(i) - row : row - col_idx(i);
+          if (d > lmax)
+            lmax = d;
+        }
+      },
+      Kokkos::Max<int64_t>(bandwidth));
+
+  Kokkos::parallel_reduce(
+      "Profile", policy_t(0, A.num_rows()),
+      KOKKOS_LAMBDA(const int64_t row, int64_t &lsum) {
+        int64_t min_col = row;
+        for (int64_t i = row_ptr(row); i < row_ptr(row + 1); ++i)
+          if (col_idx(i) < min_col)
+            min_col = col_idx(i);
+        lsum += row - min_col;
+      },
+      profile);
+}
+
+// A deliberately bad ordering, used to emulate matrices that arrive with
+// no locality: i -> (a*i) mod n for a prime a that does not divide n.
+template <class MemSpace>
+Kokkos::View<int64_t *, MemSpace> scramble_permutation(int64_t n) {
+  using policy_t = Kokkos::RangePolicy<typename MemSpace::execution_space>;
+  const int64_t a = n % 1000003 != 0 ? 1000003 : 1000033;
+  Kokkos::View<int64_t *, MemSpace> perm("scramble::perm", n);
+  Kokkos::parallel_for(
+      "Scramble", policy_t(0, n),
+      KOKKOS_LAMBDA(const int64_t i) { perm(i) = (a % n) * i % n; });
+  return perm;
+}
+
+// Level-synchronous Cuthill-McKee BFS from start, in parallel over the
+// vertices of each level. The children of a frontier vertex are the
+// unvisited neighbours for which it is the first (lowest position) parent;
+// they are appended in parent order and sorted by degree, which gives the
+// same order as the serial algorithm. claim(u) is n while u is unvisited,
+// the position of its parent while the level is being built, and -1 once u
+// is placed. Unreached components are started from their minimum degree
+// vertex. Returns the positions [begin, last_level_end) of the last level
+// of the first component.
+template <class MemSpace>
+int64_t cuthill_mckee_bfs(const CrsMatrix<MemSpace> &A, int64_t start,
+                          Kokkos::View<int64_t *, MemSpace> perm,
+                          int64_t &last_level_end) {
+  using policy_t = Kokkos::RangePolicy<typename MemSpace::execution_space>;
+  using minloc_t = Kokkos::MinLoc<int64_t, int64_t>;
+  const int64_t n = A.num_rows();
+  auto row_ptr = A.row_ptr;
+  auto col_idx = A.col_idx;
+
+  Kokkos::View<int64_t *, MemSpace> claim("rcm::claim", n);
+  Kokkos::View<int64_t *, MemSpace> offsets("rcm::offsets", n + 1);
+  Kokkos::deep_copy(claim, n);
+
+  int64_t begin = 0, end = 0;
+  int64_t last_level = -1;
+  while (end < n) {
+    if (end > 0) {
+      typename minloc_t::value_type next;
+      Kokkos::parallel_reduce(
+          "RcmNextComponent", policy_t(0, n),
+          KOKKOS_LAMBDA(const int64_t u,
+                        typename minloc_t::value_type &lnext) {
+            const int64_t degree = row_ptr(u + 1) - row_ptr(u);
+            if (claim(u) == n &&
+                (degree < lnext.val ||
+                 (degree == lnext.val && u < lnext.loc))) {
+              lnext.val = degree;
+              lnext.loc = u;
+            }
+          },
+          minloc_t(next));
+      start = next.loc;
+    }
+    Kokkos::deep_copy(Kokkos::subview(perm, end), start);
+    Kokkos::deep_copy(Kokkos::subview(claim, start), int64_t(-1));
+    begin = end;
+    end = end + 1;
+
+    while (end > begin) {
+      // Every unvisited neighbour keeps the lowest frontier position.
+      Kokkos::parallel_for(
+          "RcmClaim", policy_t(begin, end), KOKKOS_LAMBDA(const int64_t p) {
+            const int64_t v = perm(p);
+            for (int64_t i = row_ptr(v); i < row_ptr(v + 1); ++i)
+              if (claim(col_idx(i)) > p)
+                Kokkos::atomic_min(&claim(col_idx(i)), p);
+          });
+
+      // Count children once each (rows may hold duplicate columns) by
+      // moving their claim from p to -2-p.
+      Kokkos::parallel_for(
+          "RcmCount", policy_t(begin, end), KOKKOS_LAMBDA(const int64_t p) {
+            const int64_t v = perm(p);
+            int64_t count = 0;
+            for (int64_t i = row_ptr(v); i < row_ptr(v + 1); ++i)
+              if (Kokkos::atomic_compare_exchange(&claim(col_idx(i)), p,
+                                                  -2 - p) == p)
+                ++count;
+            offsets(p - begin) = count;
+          });
+
+      int64_t total = 0;
+      Kokkos::parallel_scan(
+          "RcmOffsets", policy_t(0, end - begin),
+          KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+            const int64_t count = offsets(i);
+            if (final)
+              offsets(i) = update;
+            update += count;
+          },
+          total);
+
+      const int64_t next = end;
+      Kokkos::parallel_for(
+          "RcmPlace", policy_t(begin, end), KOKKOS_LAMBDA(const int64_t p) {
+            const int64_t v = perm(p);
+            const int64_t first = next + offsets(p - begin);
+            int64_t pos = first;
+            for (int64_t i = row_ptr(v); i < row_ptr(v + 1); ++i) {
+              const int64_t u = col_idx(i);
+              if (Kokkos::atomic_compare_exchange(&claim(u), -2 - p,
+                                                  int64_t(-1)) == -2 - p)
+                perm(pos++) = u;
+            }
+            // Order siblings by increasing degree, then by index.
+            for (int64_t j = first + 1; j < pos; ++j) {
+              const int64_t u = perm(j);
+              const int64_t du = row_ptr(u + 1) - row_ptr(u);
+              int64_t k = j - 1;
+              while (k >= first) {
+                const int64_t w = perm(k);
+                const int64_t dw = row_ptr(w + 1) - row_ptr(w);
+                if (dw < du || (dw == du && w < u))
+                  break;
+                perm(k + 1) = w;
+                --k;
+              }
+              perm(k + 1) = u;
+            }
+          });
+
+      if (total == 0 && last_level < 0) {
+        last_level = begin;
+        last_level_end = end;
+      }
+      begin = end;
+      end += total;
+    }
+  }
+  return last_level;
+}
+
+// Reverse Cuthill-McKee permutation (new -> old). The start vertex is a
+// pseudo-peripheral one: a first BFS from a minimum degree vertex, then the
+// minimum degree vertex of its last level.
+template <class MemSpace>
+Kokkos::View<int64_t *, MemSpace>
+rcm_permutation(const CrsMatrix<MemSpace> &A) {
+  using policy_t = Kokkos::RangePolicy<typename MemSpace::execution_space>;
+  using minloc_t = Kokkos::MinLoc<int64_t, int64_t>;
+  const int64_t n = A.num_rows();
+  auto row_ptr = A.row_ptr;
+  Kokkos::View<int64_t *, MemSpace> perm("rcm::perm", n);
+  if (n == 0)
+    return perm;
+
+  typename minloc_t::value_type start;
+  Kokkos::parallel_reduce(
+      "RcmMinDegree", policy_t(0, n),
+      KOKKOS_LAMBDA(const int64_t u, typename minloc_t::value_type &lstart) {
+        const int64_t degree = row_ptr(u + 1) - row_ptr(u);
+        if (degree < lstart.val || (degree == lstart.val && u < lstart.loc)) {
+          lstart.val = degree;
+          lstart.loc = u;
+        }
+      },
+      minloc_t(start));
+
+  int64_t last_level_end = n;
+  int64_t last_level =
+      cuthill_mckee_bfs(A, start.loc, perm, last_level_end);
+  Kokkos::parallel_reduce(
+      "RcmPeripheral", policy_t(last_level, last_level_end),
+      KOKKOS_LAMBDA(const int64_t p, typename minloc_t::value_type &lstart) {
+        const int64_t u = perm(p);
+        const int64_t degree = row_ptr(u + 1) - row_ptr(u);
+        if (degree < lstart.val || (degree == lstart.val && u < lstart.loc)) {
+          lstart.val = degree;
+          lstart.loc = u;
+        }
+      },
+      minloc_t(start));
+
+  cuthill_mckee_bfs(A, start.loc, perm, last_level_end);
+
+  Kokkos::View<int64_t *, MemSpace> rcm("rcm::reversed", n);
+  Kokkos::parallel_for(
+      "RcmReverse", policy_t(0, n),
+      KOKKOS_LAMBDA(const int64_t i) { rcm(i) = perm(n - 1 - i); });
+  return rcm;
+}
+
+// P A P^T: row i is old row perm(i) with columns renumbered and sorted.
+template <class MemSpace>
+CrsMatrix<MemSpace> permute_matrix(const CrsMatrix<MemSpace> &A,
+                                   Kokkos::View<int64_t *, MemSpace> perm) {
+  using policy_t = Kokkos::RangePolicy<typename MemSpace::execution_space>;
+  const int64_t n = A.num_rows();
+  auto A_row_ptr = A.row_ptr;
+  auto A_col_idx = A.col_idx;
+  auto A_values = A.values;
+
+  Kokkos::View<int64_t *, MemSpace> iperm("permute::iperm", n);
+  Kokkos::View<int64_t *, MemSpace> row_ptr("permute::row_ptr", n + 1);
+  Kokkos::parallel_for(
+      "PermuteCount", policy_t(0, n), KOKKOS_LAMBDA(const int64_t i) {
+        iperm(perm(i)) = i;
+        row_ptr(i + 1) = A_row_ptr(perm(i) + 1) - A_row_ptr(perm(i));
+      });
+
+  int64_t nnz = 0;
+  Kokkos::parallel_scan(
+      "PermuteRowPtr", policy_t(0, n + 1),
+      KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+        update += row_ptr(i);
+        if (final)
+          row_ptr(i) = update;
+      },
+      nnz);
+
+  Kokkos::View<int64_t *, MemSpace> col_idx("permute::col_idx", nnz);
+  Kokkos::View<double *, MemSpace> values("permute::values", nnz);
+  Kokkos::parallel_for(
+      "PermuteFill", policy_t(0, n), KOKKOS_LAMBDA(const int64_t i) {
+        const int64_t first = row_ptr(i);
+        const int64_t old_start = A_row_ptr(perm(i));
+        const int64_t length = row_ptr(i + 1) - first;
+        // Insertion sort by new column; matrix rows are short.
+        for (int64_t j = 0; j < length; ++j) {
+          const int64_t col = iperm(A_col_idx(old_start + j));
+          const double val = A_values(old_start + j);
+          int64_t k = first + j - 1;
+          while (k >= first && col_idx(k) > col) {
+            col_idx(k + 1) = col_idx(k);
+            values(k + 1) = values(k);
+            --k;
+          }
+          col_idx(k + 1) = col;
+          values(k + 1) = val;
+        }
+      });
+
+  return CrsMatrix<MemSpace>(row_ptr, col_idx, values, A.num_cols());
+}
+
+// out(i) = v(perm(i)): a vector in the old numbering to the new one.
+template <class VType, class PermType>
+VType permute_vector(VType v, PermType perm) {
+  VType out(v.label() + "_permuted", v.extent(0));
+  Kokkos::parallel_for(
+      "PermuteVector", v.extent(0),
+      KOKKOS_LAMBDA(const int64_t i) { out(i) = v(perm(i)); });
+  return out;
+}
+
+// out(perm(i)) = v(i): maps a vector (e.g. a solution) back.
+template <class VType, class PermType>
+VType unpermute_vector(VType v, PermType perm) {
+  VType out(v.label() + "_unpermuted", v.extent(0));
+  Kokkos::parallel_for(
+      "UnpermuteVector", v.extent(0),
+      KOKKOS_LAMBDA(const int64_t i) { out(perm(i)) = v(i); });
+  return out;
+}
+
+} // namespace Impl
+#endif
@@ -0,0 +1,249 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef SPGEMM_HPP
+#define SPGEMM_HPP
+
+#include <coo_builder.hpp>
+#include <generate_matrix.hpp>
+#include <synthetic_matrix.hpp>
+
+namespace Impl {
+
+// Open addressing set of column indices in team scratch. capacity is a
+// power of two at least twice the number of keys, so probing terminates.
+template <class TableType>
+KOKKOS_INLINE_FUNCTION bool spgemm_insert(const TableType &table,
+                                          int64_t capacity, int64_t key) {
+  int64_t slot = synthetic_hash(key) & (capacity - 1);
+  while (true) {
+    const int64_t old =
+        Kokkos::atomic_compare_exchange(&table(slot), int64_t(-1), key);
+    if (old == -1)
+      return true;
+    if (old == key)
+      return false;
+    slot = (slot + 1) & (capacity - 1);
+  }
+}
+
+KOKKOS_INLINE_FUNCTION
+int64_t spgemm_capacity(int64_t upper_bound) {
+  int64_t capacity = 1;
+  while (capacity < 2 * upper_bound)
+    capacity *= 2;
+  return capacity;
+}
+
+// Symbolic phase of C = A * B: the sparsity pattern of C, with sorted
+// rows and zero values. Each team handles one row of C and collects its
+// columns in a hash set in team scratch, sized from the row's upper bound
+// (the sum of the lengths of the B rows it touches). One pass counts the
+// distinct columns, a scan gives row_ptr, and a second pass writes and
+// sorts them. With one thread per team on the host the set is effectively
+// per thread.
+template <class MemSpace>
+CrsMatrix<MemSpace> spgemm_symbolic(const CrsMatrix<MemSpace> &A,
+                                    const CrsMatrix<MemSpace> &B) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+  using team_policy_t = Kokkos::TeamPolicy<ExecSpace>;
+  using member_t = typename team_policy_t::member_type;
+  using table_t =
+      Kokkos::View<int64_t *, typename ExecSpace::scratch_memory_space,
+                   Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+
+  const int64_t nrows = A.num_rows();
+  auto A_row_ptr = A.row_ptr;
+  auto A_col_idx = A.col_idx;
+  auto B_row_ptr = B.row_ptr;
+  auto B_col_idx = B.col_idx;
+
+  Kokkos::View<int64_t *, MemSpace> bound("spgemm::bound", nrows);
+  int64_t max_bound = 0;
+  Kokkos::parallel_reduce(
+      "SpgemmBound", policy_t(0, nrows),
+      KOKKOS_LAMBDA(const int64_t row, int64_t &lmax) {
+        int64_t b = 0;
+        for (int64_t k = A_row_ptr(row); k < A_row_ptr(row + 1); ++k)
+          b += B_row_ptr(A_col_idx(k) + 1) - B_row_ptr(A_col_idx(k));
+        bound(row) = b;
+        if (b > lmax)
+          lmax = b;
+      },
+      Kokkos::Max<int64_t>(max_bound));
+
+  // The table plus one counter; level 1 when level 0 is too small.
+  const size_t bytes = table_t::shmem_size(spgemm_capacity(max_bound) + 1);
+  const int level = bytes <= size_t(team_policy_t::scratch_size_max(0)) ? 0 : 1;
+  team_policy_t policy(nrows, Kokkos::AUTO);
+  policy = policy.set_scratch_size(level, Kokkos::PerTeam(bytes));
+
+  // Pass 0 counts the columns of every row, pass 1 writes them at row_ptr
+  // and sorts them.
+  Kokkos::View<int64_t *, MemSpace> row_ptr("spgemm::row_ptr", nrows + 1);
+  Kokkos::View<int64_t *, MemSpace> col_idx;
+  int64_t nnz = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    const bool fill = pass == 1;
+    if (fill) {
+      Kokkos::parallel_scan(
+          "SpgemmRowPtr", policy_t(0, nrows + 1),
+          KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+            update += row_ptr(i);
+            if (final)
+              row_ptr(i) = update;
+          },
+          nnz);
+      col_idx = Kokkos::View<int64_t *, MemSpace>(
+          Kokkos::view_alloc(Kokkos::WithoutInitializing, "spgemm::col_idx"),
+          nnz);
+    }
+
+    Kokkos::parallel_for(
+        fill ? "SpgemmFill" : "SpgemmCount", policy,
+        KOKKOS_LAMBDA(const member_t &team) {
+          const int64_t row = team.league_rank();
+          const int64_t capacity = spgemm_capacity(bound(row));
+          table_t table(team.team_scratch(level), capacity + 1);
+          Kokkos::parallel_for(Kokkos::TeamThreadRange(team, capacity + 1),
+                               [&](const int64_t i) {
+                                 table(i) = i < capacity ? -1 : 0;
+                               });
+          team.team_barrier();
+
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, A_row_ptr(row),
+                                      A_row_ptr(row + 1)),
+              [&](const int64_t k) {
+                const int64_t a_col = A_col_idx(k);
+                for (int64_t j = B_row_ptr(a_col); j < B_row_ptr(a_col + 1);
+                     ++j) {
+                  const int64_t col = B_col_idx(j);
+                  if (spgemm_insert(table, capacity, col)) {
+                    const int64_t pos = Kokkos::atomic_fetch_add(
+                        &table(capacity), int64_t(1));
+                    if (fill)
+                      col_idx(row_ptr(row) + pos) = col;
+                  }
+                }
+              });
+          team.team_barrier();
+
+          Kokkos::single(Kokkos::PerTeam(team), [&]() {
+            if (fill)
+              sort_indices(col_idx.data() + row_ptr(row), table(capacity),
+                           [](int64_t a, int64_t b) { return a < b; });
+            else
+              row_ptr(row + 1) = table(capacity);
+          });
+        });
+  }
+
+  Kokkos::View<double *, MemSpace> values("spgemm::values", nnz);
+  return CrsMatrix<MemSpace>(row_ptr, col_idx, values, B.num_cols());
+}
+
+// Numeric phase: recompute the values of C = A * B in the structure found
+// by spgemm_symbolic, which stays valid as long as the patterns of A and B
+// do not change. Every product A(row,k)*B(k,col) is added to C(row,col),
+// located by binary search in the sorted row of C.
+template <class MemSpace>
+void spgemm_numeric(const CrsMatrix<MemSpace> &A, const CrsMatrix<MemSpace> &B,
+                    const CrsMatrix<MemSpace> &C) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using team_policy_t = Kokkos::TeamPolicy<ExecSpace>;
+  using member_t = typename team_policy_t::member_type;
+
+  auto A_row_ptr = A.row_ptr;
+  auto A_col_idx = A.col_idx;
+  auto A_values = A.values;
+  auto B_row_ptr = B.row_ptr;
+  auto B_col_idx = B.col_idx;
+  auto B_values = B.values;
+  auto C_row_ptr = C.row_ptr;
+  auto C_col_idx = C.col_idx;
+  auto C_values = C.values;
+
+  Kokkos::parallel_for(
+      "SpgemmNumeric", team_policy_t(A.num_rows(), Kokkos::AUTO),
+      KOKKOS_LAMBDA(const member_t &team) {
+        const int64_t row = team.league_rank();
+        const int64_t c_begin = C_row_ptr(row), c_end = C_row_ptr(row + 1);
+        Kokkos::parallel_for(Kokkos::TeamThreadRange(team, c_begin, c_end),
+                             [&](const int64_t i) { C_values(i) = 0.; });
+        team.team_barrier();
+
+        Kokkos::parallel_for(
+            Kokkos::TeamThreadRange(team, A_row_ptr(row), A_row_ptr(row + 1)),
+            [&](const int64_t k) {
+              const int64_t a_col = A_col_idx(k);
+              const double a_val = A_values(k);
+              for (int64_t j = B_row_ptr(a_col); j < B_row_ptr(a_col + 1);
+                   ++j) {
+                const int64_t col = B_col_idx(j);
+                int64_t lo = c_begin, hi = c_end;
+                while (hi - lo > 1) {
+                  const int64_t mid = (lo + hi) / 2;
+                  if (C_col_idx(mid) <= col)
+                    lo = mid;
+                  else
+                    hi = mid;
+                }
+                Kokkos::atomic_add(&C_values(lo), a_val * B_values(j));
+              }
+            });
+      });
+}
+
+template <class MemSpace>
+CrsMatrix<MemSpace> spgemm(const CrsMatrix<MemSpace> &A,
+                           const CrsMatrix<MemSpace> &B) {
+  CrsMatrix<MemSpace> C = spgemm_symbolic(A, B);
+  spgemm_numeric(A, B, C);
+  return C;
+}
+
+} // namespace Impl
+#endif
@@ -0,0 +1,139 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef SYMMETRIC_MATRIX_HPP
+#define SYMMETRIC_MATRIX_HPP
+
+#include <generate_matrix.hpp>
+
+// Upper triangle (including the diagonal) of a symmetric CrsMatrix.
+// The strictly lower part is implied by symmetry, so the SpMV has to add the
+// transposed contribution A(row,col)*x(row) into y(col) for every off-diagonal
+// entry. block_size is the number of rows per block used by the colored
+// kernel; it is never smaller than the upper bandwidth, so the transposed
+// writes of block k only land in blocks k and k+1.
+template <class MemSpace> struct SymCrsMatrix {
+  Kokkos::View<int64_t *, MemSpace> row_ptr;
+  Kokkos::View<int64_t *, MemSpace> col_idx;
+  Kokkos::View<double *, MemSpace> values;
+
+  int64_t _num_cols;
+  int64_t block_size;
+  KOKKOS_INLINE_FUNCTION
+  int64_t num_rows() const { return row_ptr.extent(0) - 1; }
+  KOKKOS_INLINE_FUNCTION
+  int64_t num_cols() const { return _num_cols; }
+  KOKKOS_INLINE_FUNCTION
+  int64_t nnz() const { return values.extent(0); }
+
+  SymCrsMatrix() = default;
+
+  SymCrsMatrix(Kokkos::View<int64_t *, MemSpace> row_ptr_,
+               Kokkos::View<int64_t *, MemSpace> col_idx_,
+               Kokkos::View<double *, MemSpace> values_, int64_t num_cols_,
+               int64_t block_size_)
+      : row_ptr(row_ptr_), col_idx(col_idx_), values(values_),
+        _num_cols(num_cols_), block_size(block_size_) {}
+};
+
+namespace Impl {
+
+// Keep the entries with col >= row. Runs in the execution space of MemSpace.
+template <class MemSpace>
+SymCrsMatrix<MemSpace> extract_upper_triangle(const CrsMatrix<MemSpace> &A) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  const int64_t nrows = A.num_rows();
+  auto A_row_ptr = A.row_ptr;
+  auto A_col_idx = A.col_idx;
+  auto A_values = A.values;
+
+  Kokkos::View<int64_t *, MemSpace> row_ptr("sym::row_ptr", nrows + 1);
+  Kokkos::parallel_for(
+      "SymCount", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        int64_t count = 0;
+        for (int64_t i = A_row_ptr(row); i < A_row_ptr(row + 1); ++i)
+          if (A_col_idx(i) >= row)
+            ++count;
+        row_ptr(row + 1) = count;
+      });
+
+  // Inclusive scan over [0, count_0, count_1, ...] gives the row offsets.
+  int64_t nnz = 0;
+  Kokkos::parallel_scan(
+      "SymRowPtr", policy_t(0, nrows + 1),
+      KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+        update += row_ptr(i);
+        if (final)
+          row_ptr(i) = update;
+      },
+      nnz);
+
+  Kokkos::View<int64_t *, MemSpace> col_idx("sym::col_idx", nnz);
+  Kokkos::View<double *, MemSpace> values("sym::values", nnz);
+  int64_t bandwidth = 0;
+  Kokkos::parallel_reduce(
+      "SymFill", policy_t(0, nrows),
+      KOKKOS_LAMBDA(const int64_t row, int64_t &max_bw) {
+        int64_t pos = row_ptr(row);
+        for (int64_t i = A_row_ptr(row); i < A_row_ptr(row + 1); ++i) {
+          const int64_t col = A_col_idx(i);
+          if (col >= row) {
+            col_idx(pos) = col;
+            values(pos) = A_values(i);
+            ++pos;
+            if (col - row > max_bw)
+              max_bw = col - row;
+          }
+        }
+      },
+      Kokkos::Max<int64_t>(bandwidth));
+
+  return SymCrsMatrix<MemSpace>(row_ptr, col_idx, values, A.num_cols(),
+                                bandwidth > 0 ? bandwidth : 1);
+}
+
+} // namespace Impl
+#endif
@@ -0,0 +1,281 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef SYNTHETIC_MATRIX_HPP
+#define SYNTHETIC_MATRIX_HPP
+
+#include <coo_builder.hpp>
+#include <generate_matrix.hpp>
+
+namespace Impl {
+
+// splitmix64 finalizer, used as a stateless per-row hash so the generators
+// produce the same matrix regardless of how rows are split across threads.
+KOKKOS_INLINE_FUNCTION
+uint64_t synthetic_hash(uint64_t k) {
+  k += 0x9e3779b97f4a7c15ull;
+  k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ull;
+  k = (k ^ (k >> 27)) * 0x94d049bb133111ebull;
+  return k ^ (k >> 31);
+}
+
+// Square matrix with Zipf-like row lengths: a row whose hash rank is r gets
+// min_row_length + max_row_length/(1+r) entries, so a handful of rows are
+// very long and the rest are short. Columns of a row are a contiguous,
+// sorted window at a hashed position.
+template <class MemSpace>
+CrsMatrix<MemSpace> generate_skewed_matrix(int64_t nrows,
+                                           int64_t min_row_length,
+                                           int64_t max_row_length) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  Kokkos::View<int64_t *, MemSpace> row_ptr("skewed::row_ptr", nrows + 1);
+  Kokkos::parallel_for(
+      "SkewedCount", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        const int64_t rank = synthetic_hash(row) % nrows;
+        int64_t length = min_row_length + max_row_length / (1 + rank);
+        row_ptr(row + 1) = length < nrows ? length : nrows;
+      });
+
+  int64_t nnz = 0;
+  Kokkos::parallel_scan(
+      "SkewedRowPtr", policy_t(0, nrows + 1),
+      KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+        update += row_ptr(i);
+        if (final)
+          row_ptr(i) = update;
+      },
+      nnz);
+
+  Kokkos::View<int64_t *, MemSpace> col_idx("skewed::col_idx", nnz);
+  Kokkos::View<double *, MemSpace> values("skewed::values", nnz);
+  Kokkos::parallel_for(
+      "SkewedFill", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        const int64_t row_start = row_ptr(row);
+        const int64_t length = row_ptr(row + 1) - row_start;
+        const int64_t first_col =
+            synthetic_hash(row + nrows) % (nrows - length + 1);
+        for (int64_t k = 0; k < length; ++k) {
+          col_idx(row_start + k) = first_col + k;
+          values(row_start + k) = 1.0 / (k + 1);
+        }
+      });
+
+  return CrsMatrix<MemSpace>(row_ptr, col_idx, values, nrows);
+}
+
+// Uniform double in [0, 1) from a hash.
+KOKKOS_INLINE_FUNCTION
+double synthetic_uniform(uint64_t k) {
+  return (synthetic_hash(k) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Count, scan and fill for generators whose rows can be enumerated on their
+// own: rows(row, f) calls f(col, value) for every entry of row, in column
+// order.
+template <class MemSpace, class Rows>
+CrsMatrix<MemSpace> generate_by_rows(int64_t nrows, int64_t ncols,
+                                     const Rows &rows) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  Kokkos::View<int64_t *, MemSpace> row_ptr("synthetic::row_ptr", nrows + 1);
+  Kokkos::parallel_for(
+      "SyntheticCount", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        int64_t length = 0;
+        rows(row, [&](int64_t, double) { ++length; });
+        row_ptr(row + 1) = length;
+      });
+
+  int64_t nnz = 0;
+  Kokkos::parallel_scan(
+      "SyntheticRowPtr", policy_t(0, nrows + 1),
+      KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+        update += row_ptr(i);
+        if (final)
+          row_ptr(i) = update;
+      },
+      nnz);
+
+  Kokkos::View<int64_t *, MemSpace> col_idx("synthetic::col_idx", nnz);
+  Kokkos::View<double *, MemSpace> values("synthetic::values", nnz);
+  Kokkos::parallel_for(
+      "SyntheticFill", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        int64_t pos = row_ptr(row);
+        rows(row, [&](int64_t col, double value) {
+          col_idx(pos) = col;
+          values(pos) = value;
+          ++pos;
+        });
+      });
+
+  return CrsMatrix<MemSpace>(row_ptr, col_idx, values, ncols);
+}
+
+// 5-point Laplacian on an nx x ny grid, row = i*nx + j.
+struct Laplace2DRows {
+  int64_t nx, ny;
+
+  template <class F>
+  KOKKOS_INLINE_FUNCTION void operator()(int64_t row, const F &f) const {
+    const int64_t i = row / nx, j = row % nx;
+    if (i > 0)
+      f(row - nx, -1.0);
+    if (j > 0)
+      f(row - 1, -1.0);
+    f(row, 4.0);
+    if (j < nx - 1)
+      f(row + 1, -1.0);
+    if (i < ny - 1)
+      f(row + nx, -1.0);
+  }
+};
+
+// 7-point Laplacian on an nx x ny x nz grid, row = (k*ny + i)*nx + j.
+struct Laplace3DRows {
+  int64_t nx, ny, nz;
+
+  template <class F>
+  KOKKOS_INLINE_FUNCTION void operator()(int64_t row, const F &f) const {
+    const int64_t plane = nx * ny;
+    const int64_t k = row / plane, i = (row / nx) % ny, j = row % nx;
+    if (k > 0)
+      f(row - plane, -1.0);
+    if (i > 0)
+      f(row - nx, -1.0);
+    if (j > 0)
+      f(row - 1, -1.0);
+    f(row, 6.0);
+    if (j < nx - 1)
+      f(row + 1, -1.0);
+    if (i < ny - 1)
+      f(row + nx, -1.0);
+    if (k < nz - 1)
+      f(row + plane, -1.0);
+  }
+};
+
+// Every off-diagonal (row, col) with |row - col| <= bandwidth is kept when
+// the hash of the unordered pair falls below keep, so the pattern and the
+// values in (-1, 0] are symmetric. The diagonal 2*bandwidth + 1 makes the
+// matrix strictly diagonally dominant.
+struct BandedRandomRows {
+  int64_t n, bandwidth;
+  double keep;
+
+  template <class F>
+  KOKKOS_INLINE_FUNCTION void operator()(int64_t row, const F &f) const {
+    const int64_t first = row > bandwidth ? row - bandwidth : 0;
+    const int64_t last = row + bandwidth < n - 1 ? row + bandwidth : n - 1;
+    for (int64_t col = first; col <= last; ++col) {
+      if (col == row) {
+        f(col, 2.0 * bandwidth + 1.0);
+        continue;
+      }
+      const uint64_t pair = row < col ? uint64_t(row) * n + col
+                                      : uint64_t(col) * n + row;
+      const double u = synthetic_uniform(pair);
+      if (u < keep)
+        f(col, -u / keep);
+    }
+  }
+};
+
+template <class MemSpace>
+CrsMatrix<MemSpace> generate_laplace2d_matrix(int64_t nx, int64_t ny) {
+  return generate_by_rows<MemSpace>(nx * ny, nx * ny, Laplace2DRows{nx, ny});
+}
+
+template <class MemSpace>
+CrsMatrix<MemSpace> generate_laplace3d_matrix(int64_t nx, int64_t ny,
+                                              int64_t nz) {
+  return generate_by_rows<MemSpace>(nx * ny * nz, nx * ny * nz,
+                                    Laplace3DRows{nx, ny, nz});
+}
+
+// Random band matrix with about 2*bandwidth*density + 1 entries per row.
+template <class MemSpace>
+CrsMatrix<MemSpace> generate_banded_random_matrix(int64_t n,
+                                                  int64_t bandwidth,
+                                                  double density) {
+  return generate_by_rows<MemSpace>(n, n,
+                                    BandedRandomRows{n, bandwidth, density});
+}
+
+// R-MAT power-law matrix with 2^scale rows and edge_factor * 2^scale
+// edges. Every edge descends scale levels of the quadrant recursion with
+// probabilities a, b, c and 1-a-b-c, one hash per level, so edges are
+// generated independently; repeated edges are summed by coo_to_crs, each
+// edge adding 1.
+template <class MemSpace>
+CrsMatrix<MemSpace> generate_rmat_matrix(int scale, int64_t edge_factor,
+                                         double a = 0.57, double b = 0.19,
+                                         double c = 0.19) {
+  using ExecSpace = typename MemSpace::execution_space;
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+
+  const int64_t n = int64_t(1) << scale;
+  const int64_t nedges = edge_factor * n;
+  Kokkos::View<int64_t *, MemSpace> rows("rmat::rows", nedges);
+  Kokkos::View<int64_t *, MemSpace> cols("rmat::cols", nedges);
+  Kokkos::View<double *, MemSpace> vals("rmat::vals", nedges);
+  Kokkos::parallel_for(
+      "RmatEdges", policy_t(0, nedges), KOKKOS_LAMBDA(const int64_t e) {
+        int64_t i = 0, j = 0;
+        for (int level = 0; level < scale; ++level) {
+          const double u = synthetic_uniform(uint64_t(e) * 64 + level);
+          i = 2 * i + (u >= a + b);
+          j = 2 * j + ((u >= a && u < a + b) || u >= a + b + c);
+        }
+        rows(e) = i;
+        cols(e) = j;
+        vals(e) = 1.0;
+      });
+
+  return coo_to_crs<MemSpace>(n, n, rows, cols, vals);
+}
+
+} // namespace Impl
+#endif
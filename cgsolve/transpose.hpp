@@ -0,0 +1,130 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef TRANSPOSE_HPP
+#define TRANSPOSE_HPP
+
+#include <coo_builder.hpp>
+#include <generate_matrix.hpp>
+
+namespace Impl {
+
+// A^T by count, scan and scatter. The scatter uses atomics, so every row of
+// A^T is then sorted by the position of the entry in A; that makes the
+// result stable: entries keep the order of their source rows, and repeated
+// (row, col) entries keep their order within a row. The number of columns
+// is taken from col_idx as well, because num_cols() is not reliable for
+// every generator (miniFE reports nx).
+template <class MemSpace>
+CrsMatrix<MemSpace> transpose(const CrsMatrix<MemSpace> &A) {
+  using policy_t = Kokkos::RangePolicy<typename MemSpace::execution_space>;
+  const int64_t nrows = A.num_rows();
+  auto row_ptr = A.row_ptr;
+  auto col_idx = A.col_idx;
+  auto values = A.values;
+  int64_t nnz = 0;
+  Kokkos::deep_copy(nnz, Kokkos::subview(row_ptr, nrows));
+
+  int64_t max_col = -1;
+  Kokkos::parallel_reduce(
+      "TransposeMaxCol", policy_t(0, nnz),
+      KOKKOS_LAMBDA(const int64_t k, int64_t &lmax) {
+        if (col_idx(k) > lmax)
+          lmax = col_idx(k);
+      },
+      Kokkos::Max<int64_t>(max_col));
+  const int64_t ncols = A.num_cols() > max_col + 1 ? A.num_cols() : max_col + 1;
+
+  Kokkos::View<int64_t *, MemSpace> row_of(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "transpose::row_of"),
+      nnz);
+  Kokkos::View<int64_t *, MemSpace> t_row_ptr("transpose::row_ptr",
+                                              ncols + 1);
+  Kokkos::parallel_for(
+      "TransposeCount", policy_t(0, nrows), KOKKOS_LAMBDA(const int64_t row) {
+        for (int64_t k = row_ptr(row); k < row_ptr(row + 1); ++k) {
+          row_of(k) = row;
+          Kokkos::atomic_increment(&t_row_ptr(col_idx(k) + 1));
+        }
+      });
+  Kokkos::parallel_scan(
+      "TransposeRowPtr", policy_t(0, ncols + 1),
+      KOKKOS_LAMBDA(const int64_t i, int64_t &update, const bool final) {
+        update += t_row_ptr(i);
+        if (final)
+          t_row_ptr(i) = update;
+      });
+
+  Kokkos::View<int64_t *, MemSpace> fill("transpose::fill", ncols);
+  Kokkos::View<int64_t *, MemSpace> perm(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "transpose::perm"), nnz);
+  Kokkos::parallel_for(
+      "TransposeScatter", policy_t(0, nnz), KOKKOS_LAMBDA(const int64_t k) {
+        const int64_t c = col_idx(k);
+        perm(t_row_ptr(c) + Kokkos::atomic_fetch_add(&fill(c), int64_t(1))) =
+            k;
+      });
+
+  Kokkos::View<int64_t *, MemSpace> t_col_idx(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "transpose::col_idx"),
+      nnz);
+  Kokkos::View<double *, MemSpace> t_values(
+      Kokkos::view_alloc(Kokkos::WithoutInitializing, "transpose::values"),
+      nnz);
+  Kokkos::parallel_for(
+      "TransposeFill", policy_t(0, ncols), KOKKOS_LAMBDA(const int64_t c) {
+        const int64_t begin = t_row_ptr(c), end = t_row_ptr(c + 1);
+        sort_indices(perm.data() + begin, end - begin,
+                     [](int64_t a, int64_t b) { return a < b; });
+        for (int64_t i = begin; i < end; ++i) {
+          t_col_idx(i) = row_of(perm(i));
+          t_values(i) = values(perm(i));
+        }
+      });
+
+  return CrsMatrix<MemSpace>(t_row_ptr, t_col_idx, t_values, nrows);
+}
+
+} // namespace Impl
+#endif
@@ -0,0 +1,164 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef COUNTER_RNG_HPP
+#define COUNTER_RNG_HPP
+
+#include <Kokkos_Core.hpp>
+#include <cstdint>
+#include <type_traits>
+
+// Counter-based random numbers (Philox-4x32-10, Salmon et al., SC'11).
+// Every value is a pure function of (seed, index), so a View can be filled
+// by an ordinary parallel_for in its own memory space: there is no generator
+// state to share, and the result does not depend on the backend, the number
+// of threads or the order in which the indices are visited.
+struct CounterRng {
+  uint64_t seed;
+
+  KOKKOS_INLINE_FUNCTION
+  explicit CounterRng(uint64_t seed_) : seed(seed_) {}
+
+  KOKKOS_INLINE_FUNCTION
+  static void mulhilo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo) {
+    const uint64_t p = uint64_t(a) * uint64_t(b);
+    hi = uint32_t(p >> 32);
+    lo = uint32_t(p);
+  }
+
+  // One Philox block: 128 random bits for counter value `counter`.
+  KOKKOS_INLINE_FUNCTION
+  void block(uint64_t counter, uint64_t &r0, uint64_t &r1) const {
+    uint32_t c0 = uint32_t(counter), c1 = uint32_t(counter >> 32);
+    uint32_t c2 = 0, c3 = 0;
+    uint32_t k0 = uint32_t(seed), k1 = uint32_t(seed >> 32);
+    for (int round = 0; round < 10; ++round) {
+      uint32_t hi0, lo0, hi1, lo1;
+      mulhilo(0xD2511F53u, c0, hi0, lo0);
+      mulhilo(0xCD9E8D57u, c2, hi1, lo1);
+      c0 = hi1 ^ c1 ^ k0;
+      c1 = lo1;
+      c2 = hi0 ^ c3 ^ k1;
+      c3 = lo0;
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    r0 = (uint64_t(c1) << 32) | c0;
+    r1 = (uint64_t(c3) << 32) | c2;
+  }
+
+  // 64 random bits for stream position `index`: half of block index / 2.
+  KOKKOS_INLINE_FUNCTION
+  uint64_t bits(uint64_t index) const {
+    uint64_t r0, r1;
+    block(index >> 1, r0, r1);
+    return (index & 1) ? r1 : r0;
+  }
+
+  // Map 64 random bits to [0, 1) with 53 bits of precision.
+  KOKKOS_INLINE_FUNCTION
+  static double to_unit(uint64_t r) {
+    return double(r >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  // Map 64 random bits to [lo, hi) for integral and floating point types.
+  // The modulo bias of the integer path is below 2^-32 for any range used
+  // here.
+  template <class Scalar>
+  KOKKOS_INLINE_FUNCTION static Scalar to_range(uint64_t r, Scalar lo,
+                                                Scalar hi) {
+    if (std::is_integral<Scalar>::value) {
+      const uint64_t range = uint64_t(hi - lo);
+      return range == 0 ? lo : Scalar(lo + Scalar(r % range));
+    }
+    return Scalar(lo + (hi - lo) * to_unit(r));
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  double uniform(uint64_t index) const { return to_unit(bits(index)); }
+
+  template <class Scalar>
+  KOKKOS_INLINE_FUNCTION Scalar draw(uint64_t index, Scalar lo,
+                                     Scalar hi) const {
+    return to_range(bits(index), lo, hi);
+  }
+};
+
+// Fill ptr[0, count) on `space` with values uniform in [lo, hi), taking
+// stream positions [offset, offset + count). The type of the bounds picks
+// the distribution: integral bounds give integer values in any Scalar.
+// Each iteration computes one Philox block and writes the (up to) two
+// entries it covers, so a range can be filled in pieces and still match a
+// fill of the whole range.
+template <class ExecSpace, class Scalar, class Bound>
+void fill_counter_random(const ExecSpace &space, Scalar *ptr, int64_t count,
+                         uint64_t seed, Bound lo, Bound hi,
+                         int64_t offset = 0) {
+  using policy_t = Kokkos::RangePolicy<ExecSpace>;
+  const CounterRng rng(seed);
+  const int64_t end = offset + count;
+  Kokkos::parallel_for(
+      "fill_counter_random", policy_t(space, offset / 2, (end + 1) / 2),
+      KOKKOS_LAMBDA(const int64_t b) {
+        uint64_t r[2];
+        rng.block(b, r[0], r[1]);
+        for (int h = 0; h < 2; ++h) {
+          const int64_t q = 2 * b + h;
+          if (q >= offset && q < end)
+            ptr[q - offset] = Scalar(CounterRng::to_range(r[h], lo, hi));
+        }
+      });
+}
+
+// Fill a contiguous View with values uniform in [lo, hi). Entry p of the
+// allocation gets stream position p, so two Views of the same shape and
+// layout filled with the same seed are identical on every backend.
+template <class ViewType, class Bound>
+void fill_counter_random(const ViewType &v, uint64_t seed, Bound lo,
+                         Bound hi) {
+  fill_counter_random(typename ViewType::execution_space(), v.data(),
+                      int64_t(v.span()), seed, lo, hi);
+}
+
+#endif
@@ -0,0 +1,227 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#ifndef LAUNCH_TUNER_HPP
+#define LAUNCH_TUNER_HPP
+
+#include <Kokkos_Core.hpp>
+#include <cstdio>
+#include <map>
+#include <omp.h>
+#include <string>
+#include <vector>
+
+// Launch parameters of a team kernel. A league size of 0 means one team per
+// work item (batch entry, row block, ...); a smaller league makes every
+// team loop over several items. SpMV kernels derive the league from
+// rows_per_team instead, which is only used by them. A team size of 0
+// leaves the number of threads of an OMPT team to the runtime.
+struct LaunchParams {
+  int league_size = 0;
+  int team_size = 0;
+  int vector_length = 1;
+  int rows_per_team = 0;
+};
+
+// Whether the default execution space is a GPU, where teams are wide and
+// vector lanes are hardware lanes.
+inline constexpr bool launch_on_gpu() {
+#if defined(KOKKOS_ENABLE_CUDA) || defined(KOKKOS_ENABLE_HIP) ||               \
+    defined(KOKKOS_ENABLE_OPENMPTARGET)
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Largest team_size * vector_length tried on the default execution space.
+// Host teams can use every thread of the backend.
+inline int launch_thread_cap() {
+  return launch_on_gpu() ? 1024 : Kokkos::DefaultExecutionSpace().concurrency();
+}
+
+// Largest vector_length tried; host backends get no vector lanes.
+inline int launch_vector_cap() { return launch_on_gpu() ? 32 : 1; }
+
+// Powers of two in [lo, hi].
+inline std::vector<int> launch_pow2(int lo, int hi) {
+  std::vector<int> values;
+  for (int v = lo; v <= hi; v *= 2)
+    values.push_back(v);
+  return values;
+}
+
+// Threads per team tried for OMPT kernels: at least a warp on GPUs, up to
+// every host thread otherwise.
+inline std::vector<int> launch_ompt_threads() {
+  return launch_on_gpu() ? launch_pow2(32, 1024)
+                         : launch_pow2(1, omp_get_max_threads());
+}
+
+// League sizes tried for a kernel over `work` items with teams of `threads`
+// threads: one team per item, and 1, 2 and 4 times the number of teams
+// that run at once when that is fewer.
+inline std::vector<int> launch_leagues(int64_t work, int threads) {
+  std::vector<int> leagues = {0};
+  const int64_t resident =
+      threads > 0
+          ? (Kokkos::DefaultExecutionSpace().concurrency() + threads - 1) /
+                threads
+          : 1;
+  for (int64_t k = 1; k <= 4; k *= 2)
+    if (k * resident < work)
+      leagues.push_back(int(k * resident));
+  return leagues;
+}
+
+inline std::string kokkos_backend_name() {
+  return std::string("KK:") + Kokkos::DefaultExecutionSpace::name();
+}
+
+// Seconds per call of kernel(), averaged over R calls after one warmup
+// call. Shared by the tuner callbacks and the benchmarks.
+template <class Kernel> double time_kernel(Kernel kernel, int R) {
+  kernel();
+  Kokkos::fence();
+  Kokkos::Timer timer;
+  for (int r = 0; r < R; ++r)
+    kernel();
+  Kokkos::fence();
+  return timer.seconds() / R;
+}
+
+// Tuned launch parameters kept in a text file, one line per entry:
+//   kernel shape backend league_size team_size vector_length rows_per_team
+// The file is read once on construction and new results are appended, so
+// later runs get every tuned kernel back without searching. Only a tuner
+// with search set times candidates for a shape missing from the file.
+// Kernel, shape and backend must not contain blanks.
+struct LaunchTuner {
+  std::string path;
+  bool search;
+  std::map<std::string, LaunchParams> entries;
+
+  LaunchTuner(bool search_ = false, const char *path_ = "launch_params.cache")
+      : path(path_), search(search_) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+      return;
+    char kernel[64], shape[64], backend[64];
+    LaunchParams p;
+    while (fscanf(f, "%63s %63s %63s %i %i %i %i", kernel, shape, backend,
+                  &p.league_size, &p.team_size, &p.vector_length,
+                  &p.rows_per_team) == 7)
+      entries[key(kernel, shape, backend)] = p;
+    fclose(f);
+  }
+
+  static std::string key(const char *kernel, const char *shape,
+                         const char *backend) {
+    return std::string(kernel) + " " + shape + " " + backend;
+  }
+
+  bool lookup(const char *kernel, const char *shape, const char *backend,
+              LaunchParams &p) const {
+    auto it = entries.find(key(kernel, shape, backend));
+    if (it == entries.end())
+      return false;
+    p = it->second;
+    return true;
+  }
+
+  void store(const char *kernel, const char *shape, const char *backend,
+             const LaunchParams &p) {
+    entries[key(kernel, shape, backend)] = p;
+    FILE *f = fopen(path.c_str(), "a");
+    if (f == nullptr)
+      return;
+    fprintf(f, "%s %i %i %i %i\n", key(kernel, shape, backend).c_str(),
+            p.league_size, p.team_size, p.vector_length, p.rows_per_team);
+    fclose(f);
+  }
+
+  // The cached parameters for (kernel, shape, backend). On a miss, the
+  // fastest candidate if search is set, which is then stored, and else
+  // the defaults. run(p) launches the kernel with p and returns its time
+  // in seconds.
+  template <class Run>
+  LaunchParams tune(const char *kernel, const char *shape,
+                    const char *backend, const LaunchParams &defaults,
+                    const std::vector<LaunchParams> &candidates,
+                    const Run &run) {
+    LaunchParams best = defaults;
+    if (lookup(kernel, shape, backend, best)) {
+      printf("%s: %s launch for %s found in %s\n", backend, kernel, shape,
+             path.c_str());
+    } else if (!search || candidates.empty()) {
+      printf("%s: %s launch for %s not in %s, using defaults%s\n", backend,
+             kernel, shape, path.c_str(), search ? "" : " (--tune searches)");
+      return best;
+    } else if (candidates.size() == 1) {
+      // Nothing to compare, e.g. single-thread teams on a serial backend.
+      best = candidates[0];
+      printf("%s: %s launch for %s has a single candidate, nothing swept\n",
+             backend, kernel, shape);
+      store(kernel, shape, backend, best);
+    } else {
+      double best_time = 0;
+      for (size_t c = 0; c < candidates.size(); ++c) {
+        const double t = run(candidates[c]);
+        if (c == 0 || t < best_time) {
+          best = candidates[c];
+          best_time = t;
+        }
+      }
+      printf("%s: %s launch for %s tuned over %zu candidates (%e s)\n",
+             backend, kernel, shape, candidates.size(), best_time);
+      store(kernel, shape, backend, best);
+    }
+    printf("%s: %s league %i team %i vector %i rows per team %i\n", backend,
+           kernel, best.league_size, best.team_size, best.vector_length,
+           best.rows_per_team);
+    return best;
+  }
+};
+
+#endif
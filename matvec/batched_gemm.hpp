@@ -0,0 +1,329 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+#ifndef BATCHED_GEMM_HPP
+#define BATCHED_GEMM_HPP
+
+#include <Kokkos_Core.hpp>
+#include <type_traits>
+
+#include <matvec.hpp>
+
+// Edge of the square C block a team computes, and of the A and B panels it
+// stages in team scratch. Every element loaded from memory is used
+// GEMM_TILE times.
+#ifndef GEMM_TILE
+#define GEMM_TILE 16
+#endif
+
+// Independent multiply-add chains per thread of the peak kernels, enough
+// to hide the FMA latency.
+#define PEAK_CHAINS 8
+#define PEAK_ITERS 4096
+
+// C_i = A_i * B_i for N batch entries of n x n matrices.
+template <class Scalar = double> struct BatchedGemm {
+  using ExecSpace = Kokkos::DefaultExecutionSpace;
+  using team_policy = Kokkos::TeamPolicy<ExecSpace>;
+  using member_type = typename team_policy::member_type;
+  using batch_t = Kokkos::View<Scalar ***, Kokkos::LayoutRight, ExecSpace>;
+  using scratch_t =
+      Kokkos::View<Scalar **, Kokkos::LayoutRight,
+                   typename ExecSpace::scratch_memory_space,
+                   Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+  int64_t N, n;
+  batch_t a, b, c;
+
+  // Entries are small integers, so every product is exact in all types
+  // and KK, OMPT and the host reference agree bit for bit.
+  void init() {
+    Kokkos::Timer timer;
+    auto h_a = create_mirror_view(Kokkos::HostSpace(), a);
+    auto h_b = create_mirror_view(Kokkos::HostSpace(), b);
+    for (int64_t i = 0; i < N; ++i)
+      for (int64_t r = 0; r < n; ++r)
+        for (int64_t k = 0; k < n; ++k) {
+          h_a(i, r, k) = Scalar(((i + 1) * (r + 1) + k) % 16);
+          h_b(i, r, k) = Scalar(((i + 3) * (k + 1) + r) % 16);
+        }
+    Kokkos::deep_copy(a, h_a);
+    Kokkos::deep_copy(b, h_b);
+
+    printf("Init: Timer taken = %f[secs] \n", timer.seconds());
+  }
+
+  BatchedGemm(int64_t N_, int64_t n_)
+      : N(N_), n(n_), a(batch_t("view-a", N_, n_, n_)),
+        b(batch_t("view-b", N_, n_, n_)), c(batch_t("view-c", N_, n_, n_)) {
+    init();
+  }
+
+  double flops() const { return 2. * N * n * n * n; }
+
+  // One team per GEMM_TILE x GEMM_TILE block of a C_i. The team walks the
+  // k panels, staging the A and B panels in scratch; the C block
+  // accumulates in scratch too and is written once at the end. Panels are
+  // zero padded at the matrix edge.
+  void batched_matrix_matrix_kokkos() {
+    const int T = GEMM_TILE;
+    const int64_t tiles = (n + T - 1) / T;
+    team_policy policy(N * tiles * tiles, Kokkos::AUTO);
+    policy = policy.set_scratch_size(
+        0, Kokkos::PerTeam(3 * scratch_t::shmem_size(T, T)));
+
+    Kokkos::parallel_for(
+        "BatchedGEMM", policy, KOKKOS_CLASS_LAMBDA(const member_type &team) {
+          const int64_t i = team.league_rank() / (tiles * tiles);
+          const int64_t tile = team.league_rank() % (tiles * tiles);
+          const int64_t r0 = tile / tiles * T, c0 = tile % tiles * T;
+          scratch_t sA(team.team_scratch(0), T, T);
+          scratch_t sB(team.team_scratch(0), T, T);
+          scratch_t sC(team.team_scratch(0), T, T);
+
+          Kokkos::parallel_for(Kokkos::TeamVectorRange(team, T * T),
+                               [&](const int e) { sC(e / T, e % T) = 0; });
+          for (int64_t k0 = 0; k0 < n; k0 += T) {
+            Kokkos::parallel_for(
+                Kokkos::TeamVectorRange(team, T * T), [&](const int e) {
+                  const int r = e / T, s = e % T;
+                  sA(r, s) =
+                      r0 + r < n && k0 + s < n ? a(i, r0 + r, k0 + s) : 0;
+                  sB(r, s) =
+                      k0 + r < n && c0 + s < n ? b(i, k0 + r, c0 + s) : 0;
+                });
+            team.team_barrier();
+            Kokkos::parallel_for(
+                Kokkos::TeamVectorRange(team, T * T), [&](const int e) {
+                  const int r = e / T, s = e % T;
+                  Scalar sum = sC(r, s);
+                  for (int k = 0; k < T; ++k)
+                    sum += sA(r, k) * sB(k, s);
+                  sC(r, s) = sum;
+                });
+            team.team_barrier();
+          }
+          Kokkos::parallel_for(
+              Kokkos::TeamVectorRange(team, T * T), [&](const int e) {
+                const int r = e / T, s = e % T;
+                if (r0 + r < n && c0 + s < n)
+                  c(i, r0 + r, c0 + s) = sC(r, s);
+              });
+        });
+  }
+
+  // Same blocking as the KK kernel. The panels are declared in the teams
+  // region, so they are placed in team-shared memory.
+  void batched_matrix_matrix_ompt() {
+    Scalar *a_ptr = a.data();
+    Scalar *b_ptr = b.data();
+    Scalar *c_ptr = c.data();
+    const int64_t n_ = n;
+    const int64_t tiles = (n_ + GEMM_TILE - 1) / GEMM_TILE;
+    const int64_t nteams = N * tiles * tiles;
+#pragma omp target teams distribute is_device_ptr(a_ptr, b_ptr, c_ptr)
+    for (int64_t t = 0; t < nteams; ++t) {
+      Scalar sA[GEMM_TILE * GEMM_TILE];
+      Scalar sB[GEMM_TILE * GEMM_TILE];
+      Scalar sC[GEMM_TILE * GEMM_TILE];
+      const int64_t i = t / (tiles * tiles);
+      const int64_t tile = t % (tiles * tiles);
+      const int64_t r0 = tile / tiles * GEMM_TILE;
+      const int64_t c0 = tile % tiles * GEMM_TILE;
+      const Scalar *ai = a_ptr + i * n_ * n_;
+      const Scalar *bi = b_ptr + i * n_ * n_;
+      Scalar *ci = c_ptr + i * n_ * n_;
+
+#pragma omp parallel
+      {
+#pragma omp for
+        for (int e = 0; e < GEMM_TILE * GEMM_TILE; ++e)
+          sC[e] = 0;
+        for (int64_t k0 = 0; k0 < n_; k0 += GEMM_TILE) {
+#pragma omp for
+          for (int e = 0; e < GEMM_TILE * GEMM_TILE; ++e) {
+            const int r = e / GEMM_TILE, s = e % GEMM_TILE;
+            sA[e] = r0 + r < n_ && k0 + s < n_ ? ai[(r0 + r) * n_ + k0 + s]
+                                                : 0;
+            sB[e] = k0 + r < n_ && c0 + s < n_ ? bi[(k0 + r) * n_ + c0 + s]
+                                                : 0;
+          }
+#pragma omp for
+          for (int e = 0; e < GEMM_TILE * GEMM_TILE; ++e) {
+            const int r = e / GEMM_TILE, s = e % GEMM_TILE;
+            Scalar sum = sC[e];
+            for (int k = 0; k < GEMM_TILE; ++k)
+              sum += sA[r * GEMM_TILE + k] * sB[k * GEMM_TILE + s];
+            sC[e] = sum;
+          }
+        }
+#pragma omp for
+        for (int e = 0; e < GEMM_TILE * GEMM_TILE; ++e) {
+          const int r = e / GEMM_TILE, s = e % GEMM_TILE;
+          if (r0 + r < n_ && c0 + s < n_)
+            ci[(r0 + r) * n_ + c0 + s] = sC[e];
+        }
+      }
+    }
+  }
+
+  // s and t of the peak kernels. They are read from device memory inside
+  // the kernels, so the compiler cannot fold acc * s + t into an add or a
+  // constant. |s| < 1, or s = -1 for integers, keeps every chain bounded.
+  Kokkos::View<Scalar *, ExecSpace> peak_coefficients() const {
+    Kokkos::View<Scalar *, ExecSpace> coef("peak::coef", 2);
+    auto h_coef = Kokkos::create_mirror_view(Kokkos::HostSpace(), coef);
+    const bool integral = std::is_integral<Scalar>::value;
+    h_coef(0) = integral ? Scalar(-1) : Scalar(0.999);
+    h_coef(1) = integral ? Scalar(1) : Scalar(1e-3);
+    Kokkos::deep_copy(coef, h_coef);
+    return coef;
+  }
+
+  // Multiply-add throughput with no memory traffic: nthreads threads each
+  // run PEAK_CHAINS chains of PEAK_ITERS acc = acc * s + t. Returns
+  // GFlop/s.
+  double measure_peak_kokkos(int64_t nthreads, int R) {
+    Kokkos::View<Scalar *, ExecSpace> sink("peak::sink", nthreads);
+    auto coef = peak_coefficients();
+    auto kernel = [&]() {
+      Kokkos::parallel_for(
+          "PEAK", Kokkos::RangePolicy<ExecSpace>(0, nthreads),
+          KOKKOS_LAMBDA(const int64_t j) {
+            const Scalar s = coef(0), t = coef(1);
+            Scalar acc[PEAK_CHAINS];
+            for (int l = 0; l < PEAK_CHAINS; ++l)
+              acc[l] = Scalar(j + l);
+            for (int it = 0; it < PEAK_ITERS; ++it)
+              for (int l = 0; l < PEAK_CHAINS; ++l)
+                acc[l] = acc[l] * s + t;
+            Scalar sum = 0;
+            for (int l = 0; l < PEAK_CHAINS; ++l)
+              sum += acc[l];
+            sink(j) = sum;
+          });
+    };
+    const double time = time_kernel(kernel, R);
+    return 1e-9 * 2. * PEAK_CHAINS * PEAK_ITERS * nthreads / time;
+  }
+
+  double measure_peak_ompt(int64_t nthreads, int R) {
+    Kokkos::View<Scalar *, ExecSpace> sink("peak::sink", nthreads);
+    auto coef = peak_coefficients();
+    Scalar *sink_ptr = sink.data();
+    Scalar *coef_ptr = coef.data();
+    auto kernel = [&]() {
+#pragma omp target teams distribute parallel for is_device_ptr(sink_ptr,      \
+                                                                   coef_ptr)
+      for (int64_t j = 0; j < nthreads; ++j) {
+        const Scalar s = coef_ptr[0], t = coef_ptr[1];
+        Scalar acc[PEAK_CHAINS];
+        for (int l = 0; l < PEAK_CHAINS; ++l)
+          acc[l] = Scalar(j + l);
+        for (int it = 0; it < PEAK_ITERS; ++it)
+          for (int l = 0; l < PEAK_CHAINS; ++l)
+            acc[l] = acc[l] * s + t;
+        Scalar sum = 0;
+        for (int l = 0; l < PEAK_CHAINS; ++l)
+          sum += acc[l];
+        sink_ptr[j] = sum;
+      }
+    };
+    const double time = time_kernel(kernel, R);
+    return 1e-9 * 2. * PEAK_CHAINS * PEAK_ITERS * nthreads / time;
+  }
+
+  // Number of entries of C that differ from a host triple loop.
+  int64_t check(const typename batch_t::HostMirror &h_ref) {
+    auto h_c = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), c);
+    int64_t errors = 0;
+    for (int64_t i = 0; i < N; ++i)
+      for (int64_t r = 0; r < n; ++r)
+        for (int64_t s = 0; s < n; ++s)
+          if (h_c(i, r, s) != h_ref(i, r, s))
+            ++errors;
+    return errors;
+  }
+
+  // A peak below the rate of the GEMM itself means the peak kernel did not
+  // run as written, so no fraction of it is reported.
+  void report(const char *name, double time, double peak, int64_t errors) {
+    const double rate = 1e-9 * flops() / time;
+    if (rate <= peak)
+      printf("%s: batched GEMM %li x %lix%li: %e s %lf GFlop/s, %.1lf%% of "
+             "measured peak %lf GFlop/s (%li errors)\n",
+             name, N, n, n, time, rate, 100. * rate / peak, peak, errors);
+    else
+      printf("%s: batched GEMM %li x %lix%li: %e s %lf GFlop/s, measured "
+             "peak %lf GFlop/s is below it and not valid (%li errors)\n",
+             name, N, n, n, time, rate, peak, errors);
+  }
+
+  void run_test(int R) {
+    auto h_a = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), a);
+    auto h_b = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), b);
+    // A real copy: a mirror view would alias c on host backends and be
+    // cleared with it before each check.
+    auto h_ref = Kokkos::create_mirror(Kokkos::HostSpace(), c);
+    for (int64_t i = 0; i < N; ++i)
+      for (int64_t r = 0; r < n; ++r)
+        for (int64_t s = 0; s < n; ++s) {
+          Scalar sum = 0;
+          for (int64_t k = 0; k < n; ++k)
+            sum += h_a(i, r, k) * h_b(i, k, s);
+          h_ref(i, r, s) = sum;
+        }
+
+    // Enough threads to fill the device several times over.
+    const int64_t nthreads = 4 * int64_t(ExecSpace().concurrency());
+
+    Kokkos::deep_copy(c, Scalar(0));
+    double time = time_kernel([&]() { batched_matrix_matrix_ompt(); }, R);
+    report("OMPT", time, measure_peak_ompt(nthreads, R), check(h_ref));
+
+    Kokkos::deep_copy(c, Scalar(0));
+    time = time_kernel([&]() { batched_matrix_matrix_kokkos(); }, R);
+    report("KK", time, measure_peak_kokkos(nthreads, R), check(h_ref));
+  }
+};
+
+#endif
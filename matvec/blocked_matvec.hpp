@@ -0,0 +1,276 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+#ifndef BLOCKED_MATVEC_HPP
+#define BLOCKED_MATVEC_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <omp.h>
+#include <string>
+#include <unistd.h>
+
+#include <matvec.hpp>
+
+// Rows of the blocked kernel that share every load of x.
+#define MATVEC_ROW_UNROLL 4
+
+// Host memory the blocked sweep fills with matrices of one size. Larger
+// matrices run one at a time, as long as one fits in half of the available
+// memory.
+#ifndef MATVEC_SWEEP_BYTES
+#define MATVEC_SWEEP_BYTES (int64_t(1) << 30)
+#endif
+
+struct CacheSizes {
+  int64_t l1, l2;
+};
+
+// Size in bytes of the level-level data (or unified) cache of cpu0 as
+// listed in sysfs, 0 if it is not there.
+inline int64_t sysfs_cache_size(int level) {
+  for (int index = 0;; ++index) {
+    char path[128], type[32], unit = 0;
+    int cache_level = 0;
+    int64_t size = 0;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d",
+             index);
+    std::string dir(path);
+    FILE *f = fopen((dir + "/level").c_str(), "r");
+    if (f == nullptr)
+      return 0;
+    if (fscanf(f, "%d", &cache_level) != 1)
+      cache_level = 0;
+    fclose(f);
+    f = fopen((dir + "/type").c_str(), "r");
+    if (f == nullptr || fscanf(f, "%31s", type) != 1)
+      strcpy(type, "Unknown");
+    if (f != nullptr)
+      fclose(f);
+    if (cache_level != level || strcmp(type, "Instruction") == 0)
+      continue;
+    f = fopen((dir + "/size").c_str(), "r");
+    if (f == nullptr)
+      return 0;
+    if (fscanf(f, "%li%c", &size, &unit) < 1)
+      size = 0;
+    fclose(f);
+    return unit == 'K' ? size << 10 : unit == 'M' ? size << 20 : size;
+  }
+}
+
+// Physical memory not in use, from sysconf; 4 * MATVEC_SWEEP_BYTES if the
+// C library does not know it.
+inline int64_t available_memory_bytes() {
+#if defined(_SC_AVPHYS_PAGES) && defined(_SC_PAGESIZE)
+  const int64_t pages = sysconf(_SC_AVPHYS_PAGES);
+  const int64_t page_size = sysconf(_SC_PAGESIZE);
+  if (pages > 0 && page_size > 0)
+    return pages * page_size;
+#endif
+  return 4 * MATVEC_SWEEP_BYTES;
+}
+
+// L1 data and L2 cache sizes of the host: sysconf where the C library
+// knows them, sysfs otherwise, and 32 KiB / 1 MiB if neither does.
+inline CacheSizes detect_cache_sizes() {
+  CacheSizes cache = {0, 0};
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  cache.l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  cache.l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  if (cache.l1 <= 0)
+    cache.l1 = sysfs_cache_size(1);
+  if (cache.l2 <= 0)
+    cache.l2 = sysfs_cache_size(2);
+  if (cache.l1 <= 0)
+    cache.l1 = int64_t(32) << 10;
+  if (cache.l2 <= 0)
+    cache.l2 = int64_t(1) << 20;
+  return cache;
+}
+
+// Host batched matvec y_i = m_i x_i, row by row against the whole of x_i
+// and cache blocked. The blocked kernel splits x_i into blocks of
+// col_block elements that fill half of L1 and walks a panel of row_block
+// rows over each block, MATVEC_ROW_UNROLL rows at a time, so an x block
+// is loaded from memory once per panel and every load of it from L1 feeds
+// several rows. row_block is chosen so that the panel's segments of m for
+// one x block fill half of L2. The unrolled kernel is the same panel walk
+// with a single block of all of x_i, so against it the blocked kernel
+// only gains from the column blocking.
+template <class Scalar> struct BlockedMatvec {
+  using matrix_t = Kokkos::View<Scalar ***, Kokkos::LayoutRight,
+                                Kokkos::HostSpace>;
+  using vector_t = Kokkos::View<Scalar **, Kokkos::LayoutRight,
+                                Kokkos::HostSpace>;
+  using pack_t = SimdPack<Scalar>;
+  static constexpr int W = pack_t::width;
+  int64_t batches, n;
+  int64_t col_block, row_block;
+  matrix_t m;
+  vector_t x, y_rows, y_unrolled, y_blocked;
+
+  BlockedMatvec(int64_t batches_, int64_t n_, const CacheSizes &cache)
+      : batches(batches_), n(n_),
+        m(Kokkos::view_alloc(Kokkos::WithoutInitializing, "blocked::m"),
+          batches_, n_, n_),
+        x(Kokkos::view_alloc(Kokkos::WithoutInitializing, "blocked::x"),
+          batches_, n_),
+        y_rows("blocked::y_rows", batches_, n_),
+        y_unrolled("blocked::y_unrolled", batches_, n_),
+        y_blocked("blocked::y_blocked", batches_, n_) {
+    col_block = cache.l1 / 2 / sizeof(Scalar) / W * W;
+    if (col_block < W)
+      col_block = W;
+    row_block = cache.l2 / 2 / (col_block * sizeof(Scalar)) /
+                MATVEC_ROW_UNROLL * MATVEC_ROW_UNROLL;
+    if (row_block < MATVEC_ROW_UNROLL)
+      row_block = MATVEC_ROW_UNROLL;
+
+    // Small integers, so both kernels have to agree exactly; first touch
+    // by the threads that use the rows later.
+#pragma omp parallel for collapse(2)
+    for (int64_t i = 0; i < batches; ++i)
+      for (int64_t j = 0; j < n; ++j) {
+        for (int64_t k = 0; k < n; ++k)
+          m(i, j, k) = Scalar(((i + 1) * (j + 1) + k) % 16);
+        x(i, j) = Scalar((i + 3 * j) % 16);
+      }
+  }
+
+  void matvec_rows() {
+#pragma omp parallel for collapse(2)
+    for (int64_t i = 0; i < batches; ++i)
+      for (int64_t j = 0; j < n; ++j)
+        y_rows(i, j) = simd_row_dot(&m(i, j, 0), &x(i, 0), n);
+  }
+
+  void matvec_blocked() { matvec_panels(y_blocked, col_block); }
+
+  void matvec_unrolled() { matvec_panels(y_unrolled, n); }
+
+  // Panels of row_block rows over blocks of cb columns of x.
+  void matvec_panels(const vector_t &y, int64_t cb) {
+    const int64_t panels = (n + row_block - 1) / row_block;
+#pragma omp parallel for collapse(2)
+    for (int64_t i = 0; i < batches; ++i)
+      for (int64_t p = 0; p < panels; ++p) {
+        const Scalar *xi = &x(i, 0);
+        const int64_t j0 = p * row_block;
+        const int64_t j1 = j0 + row_block < n ? j0 + row_block : n;
+        for (int64_t j = j0; j < j1; ++j)
+          y(i, j) = 0;
+
+        for (int64_t k0 = 0; k0 < n; k0 += cb) {
+          const int64_t k1 = k0 + cb < n ? k0 + cb : n;
+          int64_t j = j0;
+          for (; j + MATVEC_ROW_UNROLL <= j1; j += MATVEC_ROW_UNROLL) {
+            pack_t acc[MATVEC_ROW_UNROLL];
+            int64_t k = k0;
+            for (; k + W <= k1; k += W)
+              for (int u = 0; u < MATVEC_ROW_UNROLL; ++u)
+                acc[u].fma(&m(i, j + u, k), xi + k);
+            for (int u = 0; u < MATVEC_ROW_UNROLL; ++u) {
+              Scalar result = acc[u].sum();
+              for (int64_t kk = k; kk < k1; ++kk)
+                result += m(i, j + u, kk) * xi[kk];
+              y(i, j + u) += result;
+            }
+          }
+          for (; j < j1; ++j)
+            y(i, j) += simd_row_dot(&m(i, j, k0), xi + k0, k1 - k0);
+        }
+      }
+  }
+
+  void run_test(int R, const CacheSizes &cache) {
+    const double t_rows = time_kernel([&]() { matvec_rows(); }, R);
+    const double t_unrolled = time_kernel([&]() { matvec_unrolled(); }, R);
+    const double t_blocked = time_kernel([&]() { matvec_blocked(); }, R);
+    int64_t errors = 0;
+    for (int64_t i = 0; i < batches; ++i)
+      for (int64_t j = 0; j < n; ++j)
+        if (y_rows(i, j) != y_blocked(i, j) ||
+            y_rows(i, j) != y_unrolled(i, j))
+          ++errors;
+
+    const double bytes = sizeof(Scalar) * (1. * n * n + 2. * n) * batches;
+    printf("OMP: n %6li (x %5.2lf x L1) batches %4li: rows %lf GB/s "
+           "unrolled %lf GB/s blocked %lf GB/s, blocking speedup %.2lf "
+           "(%.2lf over rows; row block %li, col block %li, %li errors)\n",
+           n, double(n * sizeof(Scalar)) / cache.l1, batches,
+           1e-9 * bytes / t_rows, 1e-9 * bytes / t_unrolled,
+           1e-9 * bytes / t_blocked, t_unrolled / t_blocked,
+           t_rows / t_blocked, row_block, col_block, errors);
+  }
+};
+
+// Blocked against row-by-row host matvec for x_i from a quarter of L1 up
+// to 16 times L1, with as many batch entries as fit in MATVEC_SWEEP_BYTES.
+// Past that a single matrix runs, and the sweep stops early when one no
+// longer fits in half of the available memory.
+template <class Scalar> void run_blocked_sweep(int R) {
+  const CacheSizes cache = detect_cache_sizes();
+  const int64_t memory = available_memory_bytes();
+  printf("OMP: %s, L1 %li KB, L2 %li KB, %d threads, %li MB available\n",
+         matvec_type_name<Scalar>(), cache.l1 >> 10, cache.l2 >> 10,
+         omp_get_max_threads(), memory >> 20);
+  const int64_t l1_elems = cache.l1 / sizeof(Scalar);
+  for (int64_t n = l1_elems / 4; n <= 16 * l1_elems; n *= 2) {
+    const int64_t matrix_bytes = n * n * sizeof(Scalar);
+    if (matrix_bytes > memory / 2) {
+      printf("OMP: stopped before n %li (x %5.2lf x L1), one matrix needs "
+             "%li MB\n",
+             n, double(n * sizeof(Scalar)) / cache.l1, matrix_bytes >> 20);
+      break;
+    }
+    const int64_t batches = MATVEC_SWEEP_BYTES / matrix_bytes;
+    BlockedMatvec<Scalar> blocked(batches > 0 ? batches : 1, n, cache);
+    blocked.run_test(R, cache);
+  }
+}
+
+#endif
@@ -0,0 +1,266 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+#ifndef INTERLEAVED_MATVEC_HPP
+#define INTERLEAVED_MATVEC_HPP
+
+#include <cstdio>
+
+#include <counter_rng.hpp>
+#include <matvec.hpp>
+
+// Memory the interleaved sweep fills with matrices of one size.
+#ifndef MATVEC_INTERLEAVE_BYTES
+#define MATVEC_INTERLEAVE_BYTES (int64_t(256) << 20)
+#endif
+
+// Batch entries handled by one team of the interleaved KK kernel.
+#define MATVEC_INTERLEAVE_TILE 128
+
+// Batched matvec y_b = m_b x_b for many tiny n x n matrices, in the layout
+// of Matvec and batch-interleaved. The LayoutRight views give every team a
+// single small matrix, so most vector lanes have nothing to do when n is
+// below the vector length. The LayoutLeft views put the batch index
+// innermost: lane l of a team works on matrix b0 + l, and the lanes of a
+// SIMD load or a GPU warp read m(b, j, k) for consecutive b, which are
+// adjacent in memory.
+template <class Scalar = double> struct InterleavedMatvec {
+  using ExecSpace = Kokkos::DefaultExecutionSpace;
+  using team_policy = Kokkos::TeamPolicy<ExecSpace>;
+  using member_type = typename team_policy::member_type;
+  using matrix_t = Kokkos::View<Scalar ***, Kokkos::LayoutRight, ExecSpace>;
+  using vector_t = Kokkos::View<Scalar **, Kokkos::LayoutRight, ExecSpace>;
+  using imatrix_t = Kokkos::View<Scalar ***, Kokkos::LayoutLeft, ExecSpace>;
+  using ivector_t = Kokkos::View<Scalar **, Kokkos::LayoutLeft, ExecSpace>;
+  int64_t batches, n;
+  matrix_t m;
+  vector_t x, y;
+  imatrix_t im;
+  ivector_t ix, iy;
+
+  // Both layouts hold the same small integers, so all four kernels have to
+  // agree exactly.
+  void init() {
+    auto m_ = m;
+    auto x_ = x;
+    auto im_ = im;
+    auto ix_ = ix;
+    const int64_t n_ = n;
+    const CounterRng rng_m(5374857), rng_x(5374858);
+    Kokkos::parallel_for(
+        "interleaved_init", Kokkos::RangePolicy<ExecSpace>(0, batches),
+        KOKKOS_LAMBDA(const int64_t b) {
+          for (int64_t j = 0; j < n_; ++j) {
+            for (int64_t k = 0; k < n_; ++k) {
+              const Scalar v = Scalar(rng_m.draw((b * n_ + j) * n_ + k,
+                                                 int64_t(0), int64_t(16)));
+              m_(b, j, k) = v;
+              im_(b, j, k) = v;
+            }
+            const Scalar v =
+                Scalar(rng_x.draw(b * n_ + j, int64_t(0), int64_t(16)));
+            x_(b, j) = v;
+            ix_(b, j) = v;
+          }
+        });
+    Kokkos::fence();
+  }
+
+  InterleavedMatvec(int64_t batches_, int64_t n_)
+      : batches(batches_), n(n_),
+        m(Kokkos::view_alloc(Kokkos::WithoutInitializing, "interleaved::m"),
+          batches_, n_, n_),
+        x(Kokkos::view_alloc(Kokkos::WithoutInitializing, "interleaved::x"),
+          batches_, n_),
+        y("interleaved::y", batches_, n_),
+        im(Kokkos::view_alloc(Kokkos::WithoutInitializing, "interleaved::im"),
+           batches_, n_, n_),
+        ix(Kokkos::view_alloc(Kokkos::WithoutInitializing, "interleaved::ix"),
+           batches_, n_),
+        iy("interleaved::iy", batches_, n_) {
+    init();
+  }
+
+  double flops() const { return 2. * batches * n * n; }
+  double bytes() const { return sizeof(Scalar) * (n * n + 2. * n) * batches; }
+
+  // Vector length of the LayoutRight kernel: the 32-lane warp on GPUs.
+  static int vector_length() { return launch_vector_cap(); }
+
+  // One team per matrix, a thread per row and the vector lanes over the
+  // row, as in Matvec.
+  void matvec_kokkos() {
+    auto m_ = m;
+    auto x_ = x;
+    auto y_ = y;
+    const int64_t n_ = n;
+    Kokkos::parallel_for(
+        "matvec_layout_right",
+        team_policy(batches, Kokkos::AUTO, vector_length()),
+        KOKKOS_LAMBDA(const member_type &team) {
+          const int64_t b = team.league_rank();
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, n_), [&](const int64_t j) {
+                Scalar result = 0;
+                Kokkos::parallel_reduce(
+                    Kokkos::ThreadVectorRange(team, n_),
+                    [&](const int64_t k, Scalar &update) {
+                      update += m_(b, j, k) * x_(b, k);
+                    },
+                    result);
+                Kokkos::single(Kokkos::PerThread(team),
+                               [&]() { y_(b, j) = result; });
+              });
+        });
+  }
+
+  // Every thread and lane of a team owns one matrix of the team's tile and
+  // runs the whole n x n product on it.
+  void interleaved_kokkos() {
+    auto m_ = im;
+    auto x_ = ix;
+    auto y_ = iy;
+    const int64_t n_ = n, nb = batches;
+    const int64_t tiles =
+        (batches + MATVEC_INTERLEAVE_TILE - 1) / MATVEC_INTERLEAVE_TILE;
+    Kokkos::parallel_for(
+        "matvec_interleaved", team_policy(tiles, Kokkos::AUTO),
+        KOKKOS_LAMBDA(const member_type &team) {
+          const int64_t b0 = team.league_rank() * MATVEC_INTERLEAVE_TILE;
+          const int64_t count = b0 + MATVEC_INTERLEAVE_TILE <= nb
+                                    ? MATVEC_INTERLEAVE_TILE
+                                    : nb - b0;
+          Kokkos::parallel_for(
+              Kokkos::TeamVectorRange(team, count), [&](const int64_t l) {
+                const int64_t b = b0 + l;
+                for (int64_t j = 0; j < n_; ++j) {
+                  Scalar result = 0;
+                  for (int64_t k = 0; k < n_; ++k)
+                    result += m_(b, j, k) * x_(b, k);
+                  y_(b, j) = result;
+                }
+              });
+        });
+  }
+
+  void matvec_ompt() {
+    Scalar *m_ptr = m.data();
+    Scalar *x_ptr = x.data();
+    Scalar *y_ptr = y.data();
+    const int64_t n_ = n;
+#pragma omp target teams distribute is_device_ptr(m_ptr, x_ptr, y_ptr)
+    for (int64_t b = 0; b < batches; ++b) {
+#pragma omp parallel for
+      for (int64_t j = 0; j < n_; ++j) {
+        Scalar result = 0;
+#pragma omp simd reduction(+ : result)
+        for (int64_t k = 0; k < n_; ++k)
+          result += m_ptr[(b * n_ + j) * n_ + k] * x_ptr[b * n_ + k];
+        y_ptr[b * n_ + j] = result;
+      }
+    }
+  }
+
+  // Entry (b, j, k) of the LayoutLeft matrix sits at b + batches * (j + n k),
+  // so the iterations b of the simd loop read contiguous memory.
+  void interleaved_ompt() {
+    Scalar *m_ptr = im.data();
+    Scalar *x_ptr = ix.data();
+    Scalar *y_ptr = iy.data();
+    const int64_t n_ = n, nb = batches;
+#pragma omp target teams distribute parallel for simd                        \
+    is_device_ptr(m_ptr, x_ptr, y_ptr)
+    for (int64_t b = 0; b < nb; ++b) {
+      for (int64_t j = 0; j < n_; ++j) {
+        Scalar result = 0;
+        for (int64_t k = 0; k < n_; ++k)
+          result += m_ptr[b + nb * (j + n_ * k)] * x_ptr[b + nb * k];
+        y_ptr[b + nb * j] = result;
+      }
+    }
+  }
+
+  void run_test(int R) {
+    const char *names[2] = {"OMPT", "KK"};
+    double t_right[2], t_inter[2];
+    int64_t errors[2] = {0, 0};
+    for (int v = 0; v < 2; ++v) {
+      if (v == 0) {
+        t_right[v] = time_kernel([&]() { matvec_ompt(); }, R);
+        t_inter[v] = time_kernel([&]() { interleaved_ompt(); }, R);
+      } else {
+        t_right[v] = time_kernel([&]() { matvec_kokkos(); }, R);
+        t_inter[v] = time_kernel([&]() { interleaved_kokkos(); }, R);
+      }
+      auto h_y = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), y);
+      auto h_iy =
+          Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), iy);
+      for (int64_t b = 0; b < batches; ++b)
+        for (int64_t j = 0; j < n; ++j)
+          if (h_y(b, j) != h_iy(b, j))
+            ++errors[v];
+      Kokkos::deep_copy(y, Scalar(0));
+      Kokkos::deep_copy(iy, Scalar(0));
+    }
+    for (int v = 0; v < 2; ++v)
+      printf("%s: n %2li batches %8li: layout right %e s %lf GB/s "
+             "interleaved %e s %lf GB/s speedup %.2lf (%li errors)\n",
+             names[v], n, batches, t_right[v], 1e-9 * bytes() / t_right[v],
+             t_inter[v], 1e-9 * bytes() / t_inter[v],
+             t_right[v] / t_inter[v], errors[v]);
+  }
+};
+
+// Interleaved against LayoutRight batched matvec for n = 4 .. 32, with as
+// many matrices as fit in MATVEC_INTERLEAVE_BYTES.
+template <class Scalar> void run_interleaved_sweep(int R) {
+  printf("InterleavedMatvec: %s\n", matvec_type_name<Scalar>());
+  for (int64_t n = 4; n <= 32; n *= 2) {
+    const int64_t batches =
+        MATVEC_INTERLEAVE_BYTES / (sizeof(Scalar) * (n * n + 2 * n));
+    InterleavedMatvec<Scalar> matvec(batches, n);
+    matvec.run_test(R);
+  }
+}
+
+#endif
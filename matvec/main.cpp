@@ -42,16 +42,116 @@
 //@HEADER
 */
 #include <Kokkos_Core.hpp>
+#include <batched_gemm.hpp>
+#include <blocked_matvec.hpp>
+#include <interleaved_matvec.hpp>
 #include <matvec.hpp>
+#include <quantized_matvec.hpp>
+#include <ragged_matvec.hpp>
+#include <streaming_matvec.hpp>
 #include <cmath>
+#include <cstring>
 
+// Which test main runs; the plain batched matvec if none is selected.
+struct Options {
+  bool tune = false;
+  int64_t gemm = 0;
+  bool blocked = false;
+  int64_t stream_mb = 0;
+  bool interleaved = false;
+  bool ragged = false;
+  bool transpose = false;
+  bool quantized = false;
+};
+
+template <class Scalar> void run(int64_t N, int R, const Options &opt) {
+  if (opt.quantized) {
+    run_quantized_test<Scalar>(N, R);
+    return;
+  }
+  if (opt.ragged) {
+    run_ragged_test<Scalar>(N, N, R);
+    return;
+  }
+  if (opt.interleaved) {
+    run_interleaved_sweep<Scalar>(R);
+    return;
+  }
+  if (opt.blocked) {
+    run_blocked_sweep<Scalar>(R);
+    return;
+  }
+  if (opt.stream_mb > 0) {
+    run_streaming_test<Scalar>(N, R, opt.stream_mb << 20);
+    return;
+  }
+  if (opt.gemm > 0) {
+    printf("BatchedGemm: %s, N = %li, n = %li\n", matvec_type_name<Scalar>(),
+           N, opt.gemm);
+    BatchedGemm<Scalar> bgemm(N, opt.gemm);
+    bgemm.run_test(R);
+    return;
+  }
+  printf("Matvec: %s, N = %li\n", matvec_type_name<Scalar>(), N);
+  Matvec<Scalar> matvec(N);
+  matvec.tune_launch(R, opt.tune);
+  if (opt.transpose)
+    matvec.run_transpose_test(R);
+  else
+    matvec.run_test(R);
+}
+
+// Usage: test N R [--type float|double|int32|int64] [--tune] [--gemm n]
+//                 [--blocked] [--stream MB] [--interleaved] [--ragged]
+//                 [--transpose] [--quantized]
+// The matvec launch comes from launch_params.cache when this N and type
+// were tuned before; --tune searches for it otherwise.
+// --gemm runs the batched GEMM of N n x n matrices instead of the matvec,
+// --blocked the host sweep of cache-blocked against row-by-row matvec,
+// --stream the matvec through chunk buffers of at most MB megabytes,
+// --interleaved the sweep of tiny matrices in batch-interleaved layout,
+// --ragged N matrices of sizes up to N against padding them all to N,
+// --transpose the products with M^T next to the forward matvec,
+// --quantized an int8 copy of the batch against the --type original.
 int main(int argc, char *argv[]) {
   Kokkos::initialize(argc, argv);
   {
     int64_t N = argc > 1 ? atoi(argv[1]) : 1000;
     int R = argc > 2 ? atoi(argv[2]) : 10;
-    Matvec matvec(N);
-    matvec.run_test(R);
+    const char *type = "int64";
+    Options opt;
+    for (int i = 3; i < argc; ++i) {
+      if (strcmp(argv[i], "--tune") == 0)
+        opt.tune = true;
+      else if (strcmp(argv[i], "--type") == 0 && i + 1 < argc)
+        type = argv[++i];
+      else if (strcmp(argv[i], "--gemm") == 0 && i + 1 < argc)
+        opt.gemm = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--blocked") == 0)
+        opt.blocked = true;
+      else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+        opt.stream_mb = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--interleaved") == 0)
+        opt.interleaved = true;
+      else if (strcmp(argv[i], "--ragged") == 0)
+        opt.ragged = true;
+      else if (strcmp(argv[i], "--transpose") == 0)
+        opt.transpose = true;
+      else if (strcmp(argv[i], "--quantized") == 0)
+        opt.quantized = true;
+    }
+
+    if (strcmp(type, "float") == 0)
+      run<float>(N, R, opt);
+    else if (strcmp(type, "double") == 0)
+      run<double>(N, R, opt);
+    else if (strcmp(type, "int32") == 0)
+      run<int32_t>(N, R, opt);
+    else if (strcmp(type, "int64") == 0)
+      run<int64_t>(N, R, opt);
+    else
+      printf("Unknown type %s, expected float, double, int32 or int64\n",
+             type);
   }
   Kokkos::finalize();
 }
@@ -41,67 +41,192 @@
 // ************************************************************************
 //@HEADER
 */
+#ifndef MATVEC_HPP
+#define MATVEC_HPP
+
 #include <Kokkos_Core.hpp>
 #include <cmath>
-#include <random>
+#include <type_traits>
+
+#include <counter_rng.hpp>
+#include <launch_tuner.hpp>
 
 #define debug 0
 
-struct Matvec {
+// Bytes of one explicit SIMD accumulator: a 64-byte vector register on the
+// host, a 16-byte vector load per thread on GPUs.
+#if defined(KOKKOS_ENABLE_CUDA) || defined(KOKKOS_ENABLE_HIP) ||               \
+    defined(KOKKOS_ENABLE_OPENMPTARGET)
+#define MATVEC_SIMD_BYTES 16
+#else
+#define MATVEC_SIMD_BYTES 64
+#endif
+
+// Most columns of M^T x that a team of the transpose kernels accumulates
+// at once; the KK kernel uses fewer when the scratch of a team is too
+// small.
+#define MATVEC_TRANSPOSE_TILE 128
+
+// Fixed-width pack of lane accumulators. Every lane only ever adds to
+// itself, so the W-wide multiply-add vectorizes (and becomes an FMA for
+// floating point types) without reassociating the sum; the lanes are only
+// added up at the end.
+template <class Scalar> struct SimdPack {
+  static constexpr int width = MATVEC_SIMD_BYTES / sizeof(Scalar) > 0
+                                   ? MATVEC_SIMD_BYTES / sizeof(Scalar)
+                                   : 1;
+  Scalar v[width];
+
+  KOKKOS_INLINE_FUNCTION
+  SimdPack() {
+    for (int l = 0; l < width; ++l)
+      v[l] = 0;
+  }
+
+  // v += a[0:width] * b[0:width]
+  KOKKOS_INLINE_FUNCTION
+  void fma(const Scalar *a, const Scalar *b) {
+#pragma omp simd
+    for (int l = 0; l < width; ++l)
+      v[l] += a[l] * b[l];
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  SimdPack &operator+=(const SimdPack &o) {
+    for (int l = 0; l < width; ++l)
+      v[l] += o.v[l];
+    return *this;
+  }
+  KOKKOS_INLINE_FUNCTION
+  void operator+=(const volatile SimdPack &o) volatile {
+    for (int l = 0; l < width; ++l)
+      v[l] += o.v[l];
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  Scalar sum() const {
+    Scalar result = 0;
+    for (int l = 0; l < width; ++l)
+      result += v[l];
+    return result;
+  }
+};
+
+namespace Kokkos {
+template <class Scalar> struct reduction_identity<SimdPack<Scalar>> {
+  KOKKOS_FORCEINLINE_FUNCTION static SimdPack<Scalar> sum() {
+    return SimdPack<Scalar>();
+  }
+};
+} // namespace Kokkos
+
+// m[0:n] . x[0:n] for one thread: a SimdPack over the W-wide chunks, then
+// the tail shorter than W. Every kernel built on this and on
+// team_simd_row_dot sums in the same order, so they agree bit for bit on
+// integer-valued entries.
+template <class Scalar>
+KOKKOS_INLINE_FUNCTION Scalar simd_row_dot(const Scalar *m, const Scalar *x,
+                                           int64_t n) {
+  constexpr int W = SimdPack<Scalar>::width;
+  SimdPack<Scalar> acc;
+  int64_t k = 0;
+  for (; k + W <= n; k += W)
+    acc.fma(m + k, x + k);
+  Scalar result = acc.sum();
+  for (; k < n; ++k)
+    result += m[k] * x[k];
+  return result;
+}
+
+// m[0:n] . x[0:n] for a team thread: its vector lanes reduce the W-wide
+// chunks into a SimdPack and each lane adds the tail. All lanes return the
+// result.
+template <class Member, class Scalar>
+KOKKOS_INLINE_FUNCTION Scalar team_simd_row_dot(const Member &team,
+                                                const Scalar *m,
+                                                const Scalar *x, int64_t n) {
+  constexpr int W = SimdPack<Scalar>::width;
+  const int64_t nchunks = n / W;
+  SimdPack<Scalar> result;
+  Kokkos::parallel_reduce(
+      Kokkos::ThreadVectorRange(team, nchunks),
+      [&](const int64_t c, SimdPack<Scalar> &update) {
+        update.fma(m + c * W, x + c * W);
+      },
+      result);
+  Scalar tail = 0;
+  for (int64_t k = nchunks * W; k < n; ++k)
+    tail += m[k] * x[k];
+  return result.sum() + tail;
+}
+
+template <class Scalar> const char *matvec_type_name();
+template <> inline const char *matvec_type_name<float>() { return "float"; }
+template <> inline const char *matvec_type_name<double>() { return "double"; }
+template <> inline const char *matvec_type_name<int32_t>() { return "int32"; }
+template <> inline const char *matvec_type_name<int64_t>() { return "int64"; }
+
+template <class Scalar = int64_t> struct Matvec {
   using ExecSpace = Kokkos::DefaultExecutionSpace;
   using team_policy = Kokkos::TeamPolicy<ExecSpace>;
-  using member_type = team_policy::member_type;
-  using vector_t = Kokkos::View<int64_t **, Kokkos::LayoutRight, ExecSpace>;
-  using matrix_t = Kokkos::View<int64_t ***, Kokkos::LayoutRight, ExecSpace>;
-  int64_t N;
+  using member_type = typename team_policy::member_type;
+  using vector_t = Kokkos::View<Scalar **, Kokkos::LayoutRight, ExecSpace>;
+  using matrix_t = Kokkos::View<Scalar ***, Kokkos::LayoutRight, ExecSpace>;
+  // Matrices are N x N; there are N of them unless the batch was adopted.
+  int64_t N, batches;
   vector_t x, y;
   matrix_t m;
 
-  void init() {
-    Kokkos::Timer timer;
-    auto h_m = create_mirror_view(Kokkos::HostSpace(), m);
-    auto h_x = create_mirror_view(Kokkos::HostSpace(), x);
-    auto h_y = create_mirror_view(Kokkos::HostSpace(), y);
-    //
-    // Use default_random_engine object to introduce randomness.
-    std::default_random_engine generator;
-    // Initialize uniform_int_distribution class.
-    std::uniform_int_distribution<int64_t> distribution(0, N);
-
-    for (int i = 0; i < N; ++i)
-      for (int j = 0; j < N; ++j)
-        for (int k = 0; k < N; ++k)
-          h_m(i, j, k) = ((i + 1) * (j + 1) * (k + 1)) % INT64_MAX;
+  // League, team and vector size of the KK kernel, league and threads per
+  // team of the OMPT kernel (0 leaves them to the batch and the runtime).
+  // tune_launch replaces both.
+  LaunchParams launch_kk = {0, 32, 32, 0};
+  LaunchParams launch_ompt = {0, 0, 1, 0};
 
-    for (int i = 0; i < N; ++i)
-      for (int j = 0; j < N; ++j) {
-        h_x(i, j) = ((i + 1) * (j + 1) * distribution(generator)) % INT_MAX;
-        h_y(i, j) = 0;
-      }
+  // Entries are integers drawn from [0, N] for int64 and from [0, 16) for
+  // the other types, so every product and row sum is exactly representable
+  // and OMPT and KK have to agree bit for bit.
+  static int64_t init_bound(int64_t N) {
+    return std::is_same<Scalar, int64_t>::value ? N + 1 : 16;
+  }
+  static constexpr uint64_t seed_m = 5374857;
+  static constexpr uint64_t seed_x = 5374858;
 
-    Kokkos::deep_copy(m, h_m);
-    Kokkos::deep_copy(x, h_x);
-    Kokkos::deep_copy(y, h_y);
+  // Filled in place with the counter-based generator, in parallel on the
+  // device; the values do not depend on the backend or the thread count.
+  void init() {
+    Kokkos::Timer timer;
+    fill_counter_random(m, seed_m, int64_t(0), init_bound(N));
+    fill_counter_random(x, seed_x, int64_t(0), init_bound(N));
+    Kokkos::deep_copy(y, Scalar(0));
+    Kokkos::fence();
 
     printf("Init: Timer taken = %f[secs] \n", timer.seconds());
   }
 
   Matvec(int64_t N_)
-      : N(N_), y(vector_t("view-y", N, N)), x(vector_t("view-x", N, N)),
-        m(matrix_t("view-m", N, N, N)) {
+      : N(N_), batches(N_), y(vector_t("view-y", N, N)),
+        x(vector_t("view-x", N, N)), m(matrix_t("view-m", N, N, N)) {
     init();
   }
 
-  void vector_ompt(int64_t *m_ptr, int64_t *x_ptr, int64_t &y) {
-    int64_t result = 0;
-#pragma omp simd reduction(+ : result)
-    for (int k = 0; k < N; ++k) {
-      result += m_ptr[k] * x_ptr[k];
-    }
-    y += result;
+  // Adopt an existing batch m(i, :, :), x(i, :), e.g. a ragged batch padded
+  // to its largest matrix. y starts at zero.
+  Matvec(const matrix_t &m_, const vector_t &x_)
+      : N(m_.extent(1)), batches(m_.extent(0)),
+        y(vector_t("view-y", m_.extent(0), m_.extent(1))), x(x_), m(m_) {}
+
+  // One batched product reads m and x and updates y.
+  double flops() const { return 2. * batches * N * N; }
+  double bytes() const {
+    return sizeof(Scalar) * (1. * batches * N * N + 3. * batches * N);
   }
 
-  void team_matvec_ompt(int64_t *m_ptr, int64_t *x_ptr, int64_t *y_ptr) {
+  void vector_ompt(Scalar *m_ptr, Scalar *x_ptr, Scalar &y) {
+    y += simd_row_dot(m_ptr, x_ptr, N);
+  }
+
+  void team_matvec_ompt(Scalar *m_ptr, Scalar *x_ptr, Scalar *y_ptr) {
 #pragma omp for
     for (int j = 0; j < N; ++j) {
       vector_ompt(m_ptr + j * N, x_ptr, y_ptr[j]);
@@ -109,13 +234,18 @@ struct Matvec {
   }
 
   void batched_matrix_vector_ompt() {
-    int64_t *m_ptr = m.data();
-    int64_t *x_ptr = x.data();
-    int64_t *y_ptr = y.data();
-#pragma omp target teams distribute is_device_ptr(m_ptr, x_ptr, y_ptr)
-    for (int i = 0; i < N; ++i) {
+    Scalar *m_ptr = m.data();
+    Scalar *x_ptr = x.data();
+    Scalar *y_ptr = y.data();
+    const int team_size = launch_ompt.team_size;
+    const int nteams =
+        launch_ompt.league_size > 0 ? launch_ompt.league_size : batches;
+#pragma omp target teams distribute num_teams(nteams)                          \
+    is_device_ptr(m_ptr, x_ptr, y_ptr)
+    for (int i = 0; i < batches; ++i) {
+      const int nthreads = team_size > 0 ? team_size : omp_get_max_threads();
       {
-#pragma omp parallel
+#pragma omp parallel num_threads(nthreads)
         { team_matvec_ompt(m_ptr + i * N * N, x_ptr + i * N, y_ptr + i * N); }
       }
     }
@@ -128,31 +258,32 @@ struct Matvec {
       batched_matrix_vector_ompt();
     }
 
-    printf("OMPT: Timer taken = %f[secs] \n", timer.seconds());
+    double time = timer.seconds();
+    printf("OMPT: Timer taken = %f[secs] %lf GFlop/s %lf GB/s\n", time,
+           1e-9 * flops() * R / time, 1e-9 * bytes() * R / time);
   }
 
+  // A team thread per row, whose vector lanes split it into W-wide chunks
+  // (team_simd_row_dot). A league smaller than the batch walks it with a
+  // stride.
   KOKKOS_INLINE_FUNCTION
   void batched_matrix_vector_kokkos() {
-    team_policy policy(m.extent(0), 32, 32);
+    team_policy policy(
+        launch_kk.league_size > 0 ? launch_kk.league_size : batches,
+        launch_kk.team_size, launch_kk.vector_length);
 
     Kokkos::parallel_for(
         policy, KOKKOS_CLASS_LAMBDA(const member_type &team) {
-          const int i = team.league_rank();
-          auto y_sub = Kokkos::subview(y, i, Kokkos::ALL);
-          auto x_sub = Kokkos::subview(x, i, Kokkos::ALL);
-          Kokkos::parallel_for(
-              Kokkos::TeamThreadRange(team, N), [&](const int j) {
-                auto m_sub = Kokkos::subview(m, i, j, Kokkos::ALL);
-                int64_t result = 0;
-                Kokkos::parallel_reduce(
-                    Kokkos::ThreadVectorRange(team, N),
-                    [&](const int k, int64_t &update) {
-                      update += m_sub(k) * x_sub(k);
-                    },
-                    result);
-
-                y_sub(j) += result;
-              });
+          for (int64_t i = team.league_rank(); i < batches;
+               i += team.league_size()) {
+            Kokkos::parallel_for(
+                Kokkos::TeamThreadRange(team, N), [&](const int64_t j) {
+                  const Scalar result =
+                      team_simd_row_dot(team, &m(i, j, 0), &x(i, 0), N);
+                  Kokkos::single(Kokkos::PerThread(team),
+                                 [&]() { y(i, j) += result; });
+                });
+          }
         });
   }
 
@@ -164,48 +295,250 @@ struct Matvec {
       batched_matrix_vector_kokkos();
     }
 
-    printf("KK: Timer taken = %f[secs] \n", timer.seconds());
+    Kokkos::fence();
+    double time = timer.seconds();
+    printf("KK: Timer taken = %f[secs] %lf GFlop/s %lf GB/s\n", time,
+           1e-9 * flops() * R / time, 1e-9 * bytes() * R / time);
   }
 
-  void warmup_ompt() {
-    int64_t *m_ptr = m.data();
-    int64_t *x_ptr = x.data();
-    int64_t *y_ptr = y.data();
-#pragma omp target teams distribute is_device_ptr(m_ptr, x_ptr, y_ptr)
-    for (int i = 0; i < N; ++i) {
-      {
-#pragma omp parallel
-        { team_matvec_ompt(m_ptr + i * N * N, x_ptr + i * N, y_ptr + i * N); }
-      }
+  using transpose_scratch_t =
+      Kokkos::View<Scalar **, Kokkos::LayoutRight,
+                   typename ExecSpace::scratch_memory_space,
+                   Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+
+  // Tile width of the KK transpose kernel for teams of ts threads: up to
+  // MATVEC_TRANSPOSE_TILE columns of partials per thread in level 0
+  // scratch, or in level 1 scratch when not even one column fits there.
+  static int64_t transpose_tile(int ts, int &level) {
+    for (level = 0; level < 2; ++level) {
+      const int64_t max_bytes = team_policy::scratch_size_max(level);
+      int64_t T = max_bytes / (int64_t(ts) * sizeof(Scalar));
+      if (T > MATVEC_TRANSPOSE_TILE)
+        T = MATVEC_TRANSPOSE_TILE;
+      while (T > 0 && int64_t(transpose_scratch_t::shmem_size(ts, T)) >
+                          max_bytes)
+        --T;
+      if (T > 0)
+        return T;
     }
+    // Not reached for any team size a backend accepts.
+    level = 1;
+    return 1;
+  }
+
+  // yt_i += M_i^T w_i without strided reads: the team walks the columns in
+  // tiles, every thread adds w(j) times the tile's part of its rows j into
+  // a private row of partials in team scratch, and the vector lanes read
+  // consecutive entries of a matrix row. The partials of all threads are
+  // then summed per column.
+  void batched_transpose_matvec_kokkos(const vector_t &w, const vector_t &yt) {
+    using scratch_t = transpose_scratch_t;
+    const int ts = launch_kk.team_size;
+    int level;
+    const int64_t T = transpose_tile(ts, level);
+    team_policy policy(batches, ts, launch_kk.vector_length);
+    policy = policy.set_scratch_size(
+        level, Kokkos::PerTeam(scratch_t::shmem_size(ts, T)));
+
+    Kokkos::parallel_for(
+        policy, KOKKOS_CLASS_LAMBDA(const member_type &team) {
+          const int i = team.league_rank();
+          const int rank = team.team_rank();
+          const int nthreads = team.team_size();
+          scratch_t part(team.team_scratch(level), nthreads, T);
+          for (int64_t k0 = 0; k0 < N; k0 += T) {
+            const int64_t len = k0 + T <= N ? T : N - k0;
+            Kokkos::parallel_for(
+                Kokkos::TeamVectorRange(team, nthreads * T),
+                [&](const int64_t p) { part(p / T, p % T) = 0; });
+            team.team_barrier();
+            Kokkos::parallel_for(
+                Kokkos::TeamThreadRange(team, N), [&](const int64_t j) {
+                  const Scalar wj = w(i, j);
+                  Kokkos::parallel_for(
+                      Kokkos::ThreadVectorRange(team, len),
+                      [&](const int64_t l) {
+                        part(rank, l) += m(i, j, k0 + l) * wj;
+                      });
+                });
+            team.team_barrier();
+            Kokkos::parallel_for(Kokkos::TeamVectorRange(team, len),
+                                 [&](const int64_t l) {
+                                   Scalar sum = 0;
+                                   for (int r = 0; r < nthreads; ++r)
+                                     sum += part(r, l);
+                                   yt(i, k0 + l) += sum;
+                                 });
+            team.team_barrier();
+          }
+        });
   }
 
-  void warmup_kk() {
-    team_policy policy(m.extent(0), 32, 32);
+  // yt_i += M_i^T w_i with the indices of the forward kernel swapped: the
+  // vector lanes walk down a column, N entries apart.
+  void batched_transpose_matvec_naive_kokkos(const vector_t &w,
+                                             const vector_t &yt) {
+    team_policy policy(batches, launch_kk.team_size, launch_kk.vector_length);
     Kokkos::parallel_for(
         policy, KOKKOS_CLASS_LAMBDA(const member_type &team) {
           const int i = team.league_rank();
-          auto m_sub = Kokkos::subview(m, i, Kokkos::ALL, Kokkos::ALL);
-          Kokkos::parallel_for(Kokkos::TeamThreadRange(team, N),
-                               [&](const int j) {
-                                 int64_t result = 0;
-                                 Kokkos::parallel_reduce(
-                                     Kokkos::ThreadVectorRange(team, N),
-                                     [&](const int k, int64_t &update) {
-                                       update += m(i, j, k) * x(i, k);
-                                     },
-                                     result);
-                                 y(i, j) += result;
-                               });
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, N), [&](const int64_t k) {
+                Scalar result = 0;
+                Kokkos::parallel_reduce(
+                    Kokkos::ThreadVectorRange(team, N),
+                    [&](const int64_t j, Scalar &update) {
+                      update += m(i, j, k) * w(i, j);
+                    },
+                    result);
+                Kokkos::single(Kokkos::PerThread(team),
+                               [&]() { yt(i, k) += result; });
+              });
         });
   }
 
+  // The OMPT twin keeps the partials of a tile thread-private and sums
+  // them with an array section reduction.
+  void batched_transpose_matvec_ompt(const vector_t &w, const vector_t &yt) {
+    Scalar *m_ptr = m.data();
+    Scalar *w_ptr = w.data();
+    Scalar *yt_ptr = yt.data();
+    const int64_t n = N;
+    const int team_size = launch_ompt.team_size;
+#pragma omp target teams distribute is_device_ptr(m_ptr, w_ptr, yt_ptr)
+    for (int64_t i = 0; i < batches; ++i) {
+      const int nthreads = team_size > 0 ? team_size : omp_get_max_threads();
+      for (int64_t k0 = 0; k0 < n; k0 += MATVEC_TRANSPOSE_TILE) {
+        const int64_t len = k0 + MATVEC_TRANSPOSE_TILE <= n
+                                ? MATVEC_TRANSPOSE_TILE
+                                : n - k0;
+        Scalar acc[MATVEC_TRANSPOSE_TILE];
+        for (int64_t l = 0; l < MATVEC_TRANSPOSE_TILE; ++l)
+          acc[l] = 0;
+#pragma omp parallel for num_threads(nthreads)                                 \
+    reduction(+ : acc[:MATVEC_TRANSPOSE_TILE])
+        for (int64_t j = 0; j < n; ++j) {
+          const Scalar wj = w_ptr[i * n + j];
+          const Scalar *mj = m_ptr + (i * n + j) * n + k0;
+#pragma omp simd
+          for (int64_t l = 0; l < len; ++l)
+            acc[l] += mj[l] * wj;
+        }
+        for (int64_t l = 0; l < len; ++l)
+          yt_ptr[i * n + k0 + l] += acc[l];
+      }
+    }
+  }
+
+  void warmup_ompt() { batched_matrix_vector_ompt(); }
+
+  void warmup_kk() { batched_matrix_vector_kokkos(); }
+
+  // Pick the launch of both kernels for this N from the tuner cache. On a
+  // miss, time every league/team/vector size if search is set, else keep
+  // the defaults. A search leaves garbage in y, run_test clears it.
+  void tune_launch(int R, bool search) {
+    LaunchTuner tuner(search);
+    const std::string kernel =
+        std::string("batched_matvec_") + matvec_type_name<Scalar>();
+    char shape[64];
+    snprintf(shape, sizeof(shape), "%li", N);
+    const int cap = launch_thread_cap();
+    std::vector<LaunchParams> kk, ompt;
+    for (int ts : launch_pow2(1, cap))
+      for (int vl : launch_pow2(1, launch_vector_cap()))
+        if (ts * vl <= cap)
+          for (int league : launch_leagues(batches, ts * vl))
+            kk.push_back({league, ts, vl, 0});
+    ompt.push_back({0, 0, 1, 0});
+    for (int ts : launch_ompt_threads())
+      for (int league : launch_leagues(batches, ts))
+        ompt.push_back({league, ts, 1, 0});
+
+    launch_kk = tuner.tune(kernel.c_str(), shape,
+                           kokkos_backend_name().c_str(), launch_kk, kk,
+                           [&](const LaunchParams &p) {
+                             launch_kk = p;
+                             return time_kernel(
+                                 [&]() { batched_matrix_vector_kokkos(); }, R);
+                           });
+    launch_ompt = tuner.tune(kernel.c_str(), shape, "OMPT", launch_ompt, ompt,
+                             [&](const LaunchParams &p) {
+                               launch_ompt = p;
+                               return time_kernel(
+                                   [&]() { batched_matrix_vector_ompt(); }, R);
+                             });
+  }
+
+  // Validates the transpose kernels through (M_i x_i) . w_i =
+  // x_i . (M_i^T w_i) for every batch entry. All entries are integers and
+  // the dot products are summed in double, so both sides are exact and
+  // have to be equal.
+  void run_transpose_test(int R) {
+    vector_t w(Kokkos::view_alloc(Kokkos::WithoutInitializing, "view-w"),
+               batches, N);
+    vector_t yt("view-yt", batches, N);
+    fill_counter_random(w, seed_x + 1, int64_t(0), init_bound(N));
+    auto h_x = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), x);
+    auto h_w = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), w);
+
+    int level;
+    const int64_t tile = transpose_tile(launch_kk.team_size, level);
+    printf("KK: transpose tile of %li columns for teams of %i in level %i "
+           "scratch\n",
+           tile, launch_kk.team_size, level);
+
+    const char *names[3] = {"OMPT", "KK", "KK naive"};
+    for (int v = 0; v < 3; ++v) {
+      auto forward = [&]() {
+        if (v == 0)
+          batched_matrix_vector_ompt();
+        else
+          batched_matrix_vector_kokkos();
+      };
+      auto transpose = [&]() {
+        if (v == 0)
+          batched_transpose_matvec_ompt(w, yt);
+        else if (v == 1)
+          batched_transpose_matvec_kokkos(w, yt);
+        else
+          batched_transpose_matvec_naive_kokkos(w, yt);
+      };
+      Kokkos::deep_copy(y, Scalar(0));
+      Kokkos::deep_copy(yt, Scalar(0));
+      forward();
+      transpose();
+      Kokkos::fence();
+      auto h_y = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), y);
+      auto h_yt = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), yt);
+      int64_t errors = 0;
+      for (int64_t i = 0; i < batches; ++i) {
+        double lhs = 0, rhs = 0;
+        for (int64_t j = 0; j < N; ++j) {
+          lhs += double(h_y(i, j)) * double(h_w(i, j));
+          rhs += double(h_x(i, j)) * double(h_yt(i, j));
+        }
+        if (lhs != rhs)
+          ++errors;
+      }
+
+      const double t_forward = time_kernel(forward, R);
+      const double t_transpose = time_kernel(transpose, R);
+      printf("%s: forward %e s %lf GB/s, transpose %e s %lf GB/s "
+             "(%li identity errors)\n",
+             names[v], t_forward, 1e-9 * bytes() / t_forward, t_transpose,
+             1e-9 * bytes() / t_transpose, errors);
+    }
+  }
+
   void run_test(int R) {
 
     // OMPT
     warmup_ompt();
-    auto y_ompt = create_mirror_view(Kokkos::HostSpace(), y);
-    for (int i = 0; i < N; ++i)
+    // Real host copies of y: a mirror view would alias y on host backends,
+    // and the KK run would overwrite the OMPT result before the check.
+    auto y_ompt = Kokkos::create_mirror(Kokkos::HostSpace(), y);
+    for (int i = 0; i < batches; ++i)
       for (int j = 0; j < N; ++j)
         y_ompt(i, j) = 0;
     Kokkos::deep_copy(y, y_ompt);
@@ -214,8 +547,8 @@ struct Matvec {
 
     // Kokkos
     warmup_kk();
-    auto y_kk = create_mirror_view(Kokkos::HostSpace(), y);
-    for (int i = 0; i < N; ++i)
+    auto y_kk = Kokkos::create_mirror(Kokkos::HostSpace(), y);
+    for (int i = 0; i < batches; ++i)
       for (int j = 0; j < N; ++j)
         y_kk(i, j) = 0;
     Kokkos::deep_copy(y, y_kk);
@@ -223,16 +556,18 @@ struct Matvec {
     Kokkos::deep_copy(y_kk, y);
 
     // Correctness : check whether OMPT and Kokkos results are the same.
-    for (int i = 0; i < N; ++i)
+    for (int i = 0; i < batches; ++i)
       for (int j = 0; j < N; ++j)
         if (y_ompt(i, j) != y_kk(i, j))
-          printf("Error: y(%d,%d): KK = %lu, OMPT = %lu\n", i, j, y_kk(i, j),
-                 y_ompt(i, j));
+          printf("Error: y(%d,%d): KK = %.17g, OMPT = %.17g\n", i, j,
+                 double(y_kk(i, j)), double(y_ompt(i, j)));
   }
 
 #if debug
-  for (int i = 0; i < N; ++i)
+  for (int i = 0; i < batches; ++i)
     for (int j = 0; j < N; ++j)
-      printf("y(%d,%d) = %lu\n", i, j, y_ompt(i, j));
+      printf("y(%d,%d) = %.17g\n", i, j, double(y_ompt(i, j)));
 #endif
 };
+
+#endif
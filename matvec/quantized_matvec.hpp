@@ -0,0 +1,248 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+#ifndef QUANTIZED_MATVEC_HPP
+#define QUANTIZED_MATVEC_HPP
+
+#include <cmath>
+#include <cstdio>
+
+#include <matvec.hpp>
+
+// Batched matvec on an int8 copy of a Matvec batch. Row j of matrix i is
+// stored as q(i, j, :) * row_scale(i, j) and vector i as qx(i, :) *
+// x_scale(i), with every scale chosen so that the largest magnitude maps
+// to 127. Products accumulate in int32, which cannot overflow below
+// N = 2^31 / 127^2 = 133144, and y is dequantized to float once per row:
+// y(i, j) = acc * row_scale(i, j) * x_scale(i). The matrix moves a quarter
+// of the bytes of a float batch and an eighth of an int64 one.
+template <class Scalar = float> struct QuantizedMatvec {
+  using ExecSpace = Kokkos::DefaultExecutionSpace;
+  using team_policy = Kokkos::TeamPolicy<ExecSpace>;
+  using member_type = typename team_policy::member_type;
+  using qmatrix_t = Kokkos::View<int8_t ***, Kokkos::LayoutRight, ExecSpace>;
+  using qvector_t = Kokkos::View<int8_t **, Kokkos::LayoutRight, ExecSpace>;
+  using scale_t = Kokkos::View<float **, Kokkos::LayoutRight, ExecSpace>;
+  using output_t = Kokkos::View<float **, Kokkos::LayoutRight, ExecSpace>;
+  int64_t N, batches;
+  qmatrix_t q;
+  qvector_t qx;
+  scale_t row_scale;
+  Kokkos::View<float *, ExecSpace> x_scale;
+  output_t y;
+  LaunchParams launch_kk = {0, 32, 32, 0};
+
+  KOKKOS_INLINE_FUNCTION
+  static int8_t quantize(double v, double inv_scale) {
+    const double r = v * inv_scale;
+    const double c = r > 127. ? 127. : r < -127. ? -127. : r;
+    return int8_t(c < 0 ? c - 0.5 : c + 0.5);
+  }
+
+  // Quantize the batch of an existing Matvec in place on the device, one
+  // row (or vector) per iteration.
+  explicit QuantizedMatvec(const Matvec<Scalar> &full)
+      : N(full.N), batches(full.batches),
+        q(Kokkos::view_alloc(Kokkos::WithoutInitializing, "quantized::q"),
+          full.batches, full.N, full.N),
+        qx(Kokkos::view_alloc(Kokkos::WithoutInitializing, "quantized::qx"),
+           full.batches, full.N),
+        row_scale("quantized::row_scale", full.batches, full.N),
+        x_scale("quantized::x_scale", full.batches),
+        y("quantized::y", full.batches, full.N) {
+    auto m = full.m;
+    auto x = full.x;
+    auto q_ = q;
+    auto qx_ = qx;
+    auto row_scale_ = row_scale;
+    auto x_scale_ = x_scale;
+    const int64_t n = N;
+    Kokkos::parallel_for(
+        "quantize_rows", Kokkos::RangePolicy<ExecSpace>(0, batches * N),
+        KOKKOS_LAMBDA(const int64_t r) {
+          const int64_t i = r / n, j = r % n;
+          double amax = 0;
+          for (int64_t k = 0; k < n; ++k) {
+            const double v = m(i, j, k) < 0 ? -double(m(i, j, k))
+                                            : double(m(i, j, k));
+            amax = v > amax ? v : amax;
+          }
+          const double scale = amax > 0 ? amax / 127. : 1.;
+          for (int64_t k = 0; k < n; ++k)
+            q_(i, j, k) = quantize(double(m(i, j, k)), 1. / scale);
+          row_scale_(i, j) = float(scale);
+        });
+    Kokkos::parallel_for(
+        "quantize_x", Kokkos::RangePolicy<ExecSpace>(0, batches),
+        KOKKOS_LAMBDA(const int64_t i) {
+          double amax = 0;
+          for (int64_t k = 0; k < n; ++k) {
+            const double v =
+                x(i, k) < 0 ? -double(x(i, k)) : double(x(i, k));
+            amax = v > amax ? v : amax;
+          }
+          const double scale = amax > 0 ? amax / 127. : 1.;
+          for (int64_t k = 0; k < n; ++k)
+            qx_(i, k) = quantize(double(x(i, k)), 1. / scale);
+          x_scale_(i) = float(scale);
+        });
+    Kokkos::fence();
+  }
+
+  double flops() const { return 2. * batches * N * N; }
+  double bytes() const {
+    return 1. * batches * N * N + (sizeof(int8_t) + 2. * sizeof(float)) *
+                                      batches * N;
+  }
+
+  void matvec_kokkos() {
+    team_policy policy(batches, launch_kk.team_size, launch_kk.vector_length);
+    Kokkos::parallel_for(
+        policy, KOKKOS_CLASS_LAMBDA(const member_type &team) {
+          const int64_t i = team.league_rank();
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, N), [&](const int64_t j) {
+                int32_t acc = 0;
+                Kokkos::parallel_reduce(
+                    Kokkos::ThreadVectorRange(team, N),
+                    [&](const int64_t k, int32_t &update) {
+                      update += int32_t(q(i, j, k)) * int32_t(qx(i, k));
+                    },
+                    acc);
+                Kokkos::single(Kokkos::PerThread(team), [&]() {
+                  y(i, j) = float(acc) * row_scale(i, j) * x_scale(i);
+                });
+              });
+        });
+  }
+
+  void matvec_ompt() {
+    int8_t *q_ptr = q.data();
+    int8_t *qx_ptr = qx.data();
+    float *rs_ptr = row_scale.data();
+    float *xs_ptr = x_scale.data();
+    float *y_ptr = y.data();
+    const int64_t n = N, nb = batches;
+#pragma omp target teams distribute is_device_ptr(q_ptr, qx_ptr, rs_ptr,     \
+                                                  xs_ptr, y_ptr)
+    for (int64_t i = 0; i < nb; ++i) {
+#pragma omp parallel for
+      for (int64_t j = 0; j < n; ++j) {
+        const int8_t *qj = q_ptr + (i * n + j) * n;
+        const int8_t *xi = qx_ptr + i * n;
+        int32_t acc = 0;
+#pragma omp simd reduction(+ : acc)
+        for (int64_t k = 0; k < n; ++k)
+          acc += int32_t(qj[k]) * int32_t(xi[k]);
+        y_ptr[i * n + j] = float(acc) * rs_ptr[i * n + j] * xs_ptr[i];
+      }
+    }
+  }
+};
+
+// Quantizes a Matvec batch, times the int8 kernels against the full
+// precision one, and reports the error of y against the full precision
+// result: the largest entry error relative to the largest |y| of its batch
+// entry, and the 2-norm error over the whole batch.
+template <class Scalar> void run_quantized_test(int64_t N, int R) {
+  printf("QuantizedMatvec: int8 from %s, N = %li\n",
+         matvec_type_name<Scalar>(), N);
+  Matvec<Scalar> full(N);
+  Kokkos::deep_copy(full.y, Scalar(0));
+  full.batched_matrix_vector_kokkos();
+  Kokkos::fence();
+  // Real copies: a mirror view aliases y on host backends, and the timed
+  // runs below keep writing to it.
+  auto h_full = Kokkos::create_mirror(Kokkos::HostSpace(), full.y);
+  Kokkos::deep_copy(h_full, full.y);
+
+  Kokkos::Timer timer;
+  QuantizedMatvec<Scalar> quantized(full);
+  printf("Quantize: Timer taken = %f[secs] \n", timer.seconds());
+
+  const double t_full =
+      time_kernel([&]() { full.batched_matrix_vector_kokkos(); }, R);
+  printf("KK %s: %e s %lf GFlop/s %lf GB/s\n", matvec_type_name<Scalar>(),
+         t_full, 1e-9 * full.flops() / t_full, 1e-9 * full.bytes() / t_full);
+
+  const char *names[2] = {"OMPT", "KK"};
+  typename QuantizedMatvec<Scalar>::output_t::HostMirror h_y[2];
+  for (int v = 0; v < 2; ++v) {
+    const double t = time_kernel(
+        [&]() {
+          if (v == 0)
+            quantized.matvec_ompt();
+          else
+            quantized.matvec_kokkos();
+        },
+        R);
+    h_y[v] = Kokkos::create_mirror(Kokkos::HostSpace(), quantized.y);
+    Kokkos::deep_copy(h_y[v], quantized.y);
+    printf("%s int8: %e s %lf GFlop/s %lf GB/s, speedup %.2lf\n", names[v], t,
+           1e-9 * quantized.flops() / t, 1e-9 * quantized.bytes() / t,
+           t_full / t);
+  }
+
+  double max_rel = 0, err2 = 0, ref2 = 0;
+  int64_t mismatches = 0;
+  for (int64_t i = 0; i < N; ++i) {
+    double ymax = 0, emax = 0;
+    for (int64_t j = 0; j < N; ++j) {
+      const double ref = double(h_full(i, j));
+      const double err = double(h_y[1](i, j)) - ref;
+      ymax = std::fabs(ref) > ymax ? std::fabs(ref) : ymax;
+      emax = std::fabs(err) > emax ? std::fabs(err) : emax;
+      err2 += err * err;
+      ref2 += ref * ref;
+      if (h_y[0](i, j) != h_y[1](i, j))
+        ++mismatches;
+    }
+    if (ymax > 0 && emax / ymax > max_rel)
+      max_rel = emax / ymax;
+  }
+  printf("int8 error: max %e relative to the largest |y| of its batch "
+         "entry, %e in 2-norm (%li OMPT/KK mismatches)\n",
+         max_rel, ref2 > 0 ? std::sqrt(err2 / ref2) : 0., mismatches);
+}
+
+#endif
@@ -0,0 +1,278 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+#ifndef RAGGED_MATVEC_HPP
+#define RAGGED_MATVEC_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <counter_rng.hpp>
+#include <matvec.hpp>
+
+// Largest padded batch the ragged test builds for the comparison against
+// Matvec.
+#ifndef MATVEC_PADDED_BYTES
+#define MATVEC_PADDED_BYTES (int64_t(2) << 30)
+#endif
+
+// Batched matvec y_b = m_b x_b over matrices of different sizes n_b.
+// Matrix b is stored row-major from m(m_off(b)), its vectors from
+// x(v_off(b)) and y(v_off(b)). The sizes are n_b = 1 + (n_max - 1) u^3 for
+// u uniform in [0, 1): most matrices are small and a few come close to
+// n_max, which is what makes padding to n_max expensive.
+//
+// Teams pick their matrix through an order array. `natural` is the batch
+// order; `sorted` is by decreasing size, so the largest matrices start
+// first, the league ends on a tail of small ones that fills the gaps, and
+// teams the backend runs side by side get similar work. The KK policy
+// schedules teams dynamically on host backends.
+template <class Scalar = double> struct RaggedMatvec {
+  using ExecSpace = Kokkos::DefaultExecutionSpace;
+  using team_policy =
+      Kokkos::TeamPolicy<ExecSpace, Kokkos::Schedule<Kokkos::Dynamic>>;
+  using member_type = typename team_policy::member_type;
+  using index_t = Kokkos::View<int64_t *, ExecSpace>;
+  using flat_t = Kokkos::View<Scalar *, ExecSpace>;
+  int64_t batches, n_max, total_m, total_v;
+  index_t sizes, m_off, v_off;
+  index_t natural, sorted;
+  flat_t m, x, y;
+  LaunchParams launch_kk = {0, 32, 32, 0};
+
+  RaggedMatvec(int64_t batches_, int64_t n_max_)
+      : batches(batches_), n_max(n_max_),
+        sizes("ragged::sizes", batches_), m_off("ragged::m_off", batches_ + 1),
+        v_off("ragged::v_off", batches_ + 1),
+        natural("ragged::natural", batches_),
+        sorted("ragged::sorted", batches_) {
+    auto h_sizes = Kokkos::create_mirror_view(Kokkos::HostSpace(), sizes);
+    auto h_m_off = Kokkos::create_mirror_view(Kokkos::HostSpace(), m_off);
+    auto h_v_off = Kokkos::create_mirror_view(Kokkos::HostSpace(), v_off);
+    auto h_natural = Kokkos::create_mirror_view(Kokkos::HostSpace(), natural);
+    auto h_sorted = Kokkos::create_mirror_view(Kokkos::HostSpace(), sorted);
+    const CounterRng rng(5374859);
+    h_m_off(0) = 0;
+    h_v_off(0) = 0;
+    for (int64_t b = 0; b < batches; ++b) {
+      const double u = rng.uniform(b);
+      h_sizes(b) = 1 + int64_t((n_max - 1) * u * u * u);
+      h_m_off(b + 1) = h_m_off(b) + h_sizes(b) * h_sizes(b);
+      h_v_off(b + 1) = h_v_off(b) + h_sizes(b);
+    }
+    total_m = h_m_off(batches);
+    total_v = h_v_off(batches);
+
+    std::vector<int64_t> order(batches);
+    for (int64_t b = 0; b < batches; ++b)
+      order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&](int64_t a, int64_t b) {
+      return h_sizes(a) > h_sizes(b);
+    });
+    for (int64_t b = 0; b < batches; ++b) {
+      h_natural(b) = b;
+      h_sorted(b) = order[b];
+    }
+    Kokkos::deep_copy(sizes, h_sizes);
+    Kokkos::deep_copy(m_off, h_m_off);
+    Kokkos::deep_copy(v_off, h_v_off);
+    Kokkos::deep_copy(natural, h_natural);
+    Kokkos::deep_copy(sorted, h_sorted);
+
+    m = flat_t(Kokkos::view_alloc(Kokkos::WithoutInitializing, "ragged::m"),
+               total_m);
+    x = flat_t(Kokkos::view_alloc(Kokkos::WithoutInitializing, "ragged::x"),
+               total_v);
+    y = flat_t("ragged::y", total_v);
+    fill_counter_random(m, 5374857, int64_t(0), int64_t(16));
+    fill_counter_random(x, 5374858, int64_t(0), int64_t(16));
+    Kokkos::fence();
+  }
+
+  // Useful work only; padding adds none.
+  double flops() const { return 2. * total_m; }
+
+  // The Matvec kernel on matrix order(league rank), with the row and vector
+  // loops bounded by its own size.
+  void matvec_kokkos(const index_t &order) {
+    auto sizes_ = sizes;
+    auto m_off_ = m_off;
+    auto v_off_ = v_off;
+    auto m_ = m;
+    auto x_ = x;
+    auto y_ = y;
+    Kokkos::parallel_for(
+        "ragged_matvec",
+        team_policy(batches, launch_kk.team_size, launch_kk.vector_length),
+        KOKKOS_LAMBDA(const member_type &team) {
+          const int64_t b = order(team.league_rank());
+          const int64_t n = sizes_(b);
+          const Scalar *mb = &m_(m_off_(b));
+          const Scalar *xb = &x_(v_off_(b));
+          Scalar *yb = &y_(v_off_(b));
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, n), [&](const int64_t j) {
+                const Scalar result =
+                    team_simd_row_dot(team, mb + j * n, xb, n);
+                Kokkos::single(Kokkos::PerThread(team),
+                               [&]() { yb[j] = result; });
+              });
+        });
+  }
+
+  void matvec_ompt(const index_t &order) {
+    const int64_t *order_ptr = order.data();
+    const int64_t *sizes_ptr = sizes.data();
+    const int64_t *m_off_ptr = m_off.data();
+    const int64_t *v_off_ptr = v_off.data();
+    Scalar *m_ptr = m.data();
+    Scalar *x_ptr = x.data();
+    Scalar *y_ptr = y.data();
+    const int64_t nb = batches;
+#pragma omp target teams distribute is_device_ptr(                            \
+    order_ptr, sizes_ptr, m_off_ptr, v_off_ptr, m_ptr, x_ptr, y_ptr)
+    for (int64_t t = 0; t < nb; ++t) {
+      const int64_t b = order_ptr[t];
+      const int64_t n = sizes_ptr[b];
+      const Scalar *mb = m_ptr + m_off_ptr[b];
+      const Scalar *xb = x_ptr + v_off_ptr[b];
+      Scalar *yb = y_ptr + v_off_ptr[b];
+#pragma omp parallel for
+      for (int64_t j = 0; j < n; ++j)
+        yb[j] = simd_row_dot(mb + j * n, xb, n);
+    }
+  }
+
+  // Every matrix zero-padded to n_max in the layout of Matvec.
+  Matvec<Scalar> padded() const {
+    using matrix_t = typename Matvec<Scalar>::matrix_t;
+    using vector_t = typename Matvec<Scalar>::vector_t;
+    matrix_t pm("ragged::padded_m", batches, n_max, n_max);
+    vector_t px("ragged::padded_x", batches, n_max);
+    auto sizes_ = sizes;
+    auto m_off_ = m_off;
+    auto v_off_ = v_off;
+    auto m_ = m;
+    auto x_ = x;
+    Kokkos::parallel_for(
+        "ragged_pad", Kokkos::RangePolicy<ExecSpace>(0, batches),
+        KOKKOS_LAMBDA(const int64_t b) {
+          const int64_t n = sizes_(b);
+          for (int64_t j = 0; j < n; ++j) {
+            for (int64_t k = 0; k < n; ++k)
+              pm(b, j, k) = m_(m_off_(b) + j * n + k);
+            px(b, j) = x_(v_off_(b) + j);
+          }
+        });
+    Kokkos::fence();
+    return Matvec<Scalar>(pm, px);
+  }
+
+  // Entries of y that differ from the padded product, which has to hold
+  // R + 1 times m_b x_b after time_kernel.
+  int64_t errors(const Matvec<Scalar> &full, int R) const {
+    auto h_y = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), y);
+    auto h_full =
+        Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), full.y);
+    auto h_sizes =
+        Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), sizes);
+    auto h_v_off =
+        Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), v_off);
+    int64_t count = 0;
+    for (int64_t b = 0; b < batches; ++b)
+      for (int64_t j = 0; j < h_sizes(b); ++j)
+        if (Scalar(R + 1) * h_y(h_v_off(b) + j) != h_full(b, j))
+          ++count;
+    return count;
+  }
+};
+
+// Ragged batch in natural and size-sorted order against the Matvec kernels
+// on the batch padded to n_max, which is skipped when it would not fit in
+// MATVEC_PADDED_BYTES. GFlop/s count useful work only.
+template <class Scalar>
+void run_ragged_test(int64_t batches, int64_t n_max, int R) {
+  RaggedMatvec<Scalar> ragged(batches, n_max);
+  const double padded_bytes = 1. * batches * n_max * n_max * sizeof(Scalar);
+  printf("RaggedMatvec: %s, %li matrices up to %li, mean size %.1lf, "
+         "padding overhead %.2lf\n",
+         matvec_type_name<Scalar>(), batches, n_max,
+         double(ragged.total_v) / batches,
+         padded_bytes / (ragged.total_m * sizeof(Scalar)));
+
+  const bool pad = padded_bytes <= MATVEC_PADDED_BYTES;
+  if (!pad)
+    printf("Padded batch of %.0lf MB exceeds MATVEC_PADDED_BYTES, skipped\n",
+           padded_bytes / (1 << 20));
+  const char *names[2] = {"OMPT", "KK"};
+  for (int v = 0; v < 2; ++v) {
+    double t_natural, t_sorted;
+    if (v == 0) {
+      t_natural =
+          time_kernel([&]() { ragged.matvec_ompt(ragged.natural); }, R);
+      t_sorted = time_kernel([&]() { ragged.matvec_ompt(ragged.sorted); }, R);
+    } else {
+      t_natural =
+          time_kernel([&]() { ragged.matvec_kokkos(ragged.natural); }, R);
+      t_sorted =
+          time_kernel([&]() { ragged.matvec_kokkos(ragged.sorted); }, R);
+    }
+    printf("%s: natural %e s %lf GFlop/s, sorted %e s %lf GFlop/s", names[v],
+           t_natural, 1e-9 * ragged.flops() / t_natural, t_sorted,
+           1e-9 * ragged.flops() / t_sorted);
+    if (!pad) {
+      printf("\n");
+      continue;
+    }
+    Matvec<Scalar> full = ragged.padded();
+    const double t_padded =
+        v == 0 ? time_kernel([&]() { full.batched_matrix_vector_ompt(); }, R)
+               : time_kernel([&]() { full.batched_matrix_vector_kokkos(); }, R);
+    printf(", padded %e s %lf GFlop/s, speedup %.2lf (%li errors)\n",
+           t_padded, 1e-9 * ragged.flops() / t_padded, t_padded / t_sorted,
+           ragged.errors(full, R));
+  }
+}
+
+#endif
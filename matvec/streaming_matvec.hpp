@@ -0,0 +1,285 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 3.0
+//       Copyright (2020) National Technology & Engineering
+//               Solutions of Sandia, LLC (NTESS).
+//
+// Under the terms of Contract DE-NA0003525 with NTESS,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY NTESS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL NTESS OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions? Contact Christian R. Trott (crtrott@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+#ifndef STREAMING_MATVEC_HPP
+#define STREAMING_MATVEC_HPP
+
+#include <cstdio>
+#include <memory>
+#include <omp.h>
+
+#include <counter_rng.hpp>
+#include <matvec.hpp>
+
+// Largest resident matrix the streaming test allocates for its comparison
+// against Matvec.
+#ifndef MATVEC_RESIDENT_BYTES
+#define MATVEC_RESIDENT_BYTES (int64_t(2) << 30)
+#endif
+
+// Batched matvec y_i += m_i x_i that never holds the whole batch of
+// matrices. The batch goes through the kernel in chunks of `chunk`
+// matrices and two buffers: while chunk c is multiplied out of one buffer,
+// chunk c + 1 is generated into the other. Generation stands in for
+// loading the matrices and produces exactly the entries Matvec::init puts
+// into the resident matrix, so y agrees bit for bit with Matvec. Peak
+// memory is the buffers plus x and y and stays within the budget; a budget
+// that holds the whole batch gets a single buffer.
+template <class Scalar = int64_t> struct StreamingMatvec {
+  using ExecSpace = Kokkos::DefaultExecutionSpace;
+  using team_policy = Kokkos::TeamPolicy<ExecSpace>;
+  using member_type = typename team_policy::member_type;
+  using vector_t = Kokkos::View<Scalar **, Kokkos::LayoutRight, ExecSpace>;
+  using matrix_t = Kokkos::View<Scalar ***, Kokkos::LayoutRight, ExecSpace>;
+  int64_t N, chunk, nchunks;
+  vector_t x, y;
+  matrix_t buf[2];
+  // Generation and multiplication are issued to separate instances so that
+  // they overlap where the backend runs instances concurrently.
+  ExecSpace gen_space, mul_space;
+  LaunchParams launch_kk = {0, 32, 32, 0};
+
+  // Matrices per chunk for a budget of budget_bytes, which also has to
+  // hold x and y, N x N each: the whole batch if it fits in one buffer,
+  // else as many as fit in each of two. 0 if two buffers of a single
+  // matrix do not fit.
+  static int64_t chunk_for_budget(int64_t N, int64_t budget_bytes) {
+    const int64_t matrix_bytes = N * N * sizeof(Scalar);
+    const int64_t buffer_bytes = budget_bytes - 2 * matrix_bytes;
+    if (buffer_bytes >= N * matrix_bytes)
+      return N;
+    return buffer_bytes > 0 ? buffer_bytes / (2 * matrix_bytes) : 0;
+  }
+
+  // budget_bytes has to allow a chunk, see chunk_for_budget.
+  StreamingMatvec(int64_t N_, int64_t budget_bytes)
+      : N(N_), chunk(chunk_for_budget(N_, budget_bytes)),
+        x(vector_t("stream::x", N_, N_)), y(vector_t("stream::y", N_, N_)) {
+    nchunks = (N + chunk - 1) / chunk;
+    const char *labels[2] = {"stream::m0", "stream::m1"};
+    for (int b = 0; b < (nchunks > 1 ? 2 : 1); ++b)
+      buf[b] = matrix_t(
+          Kokkos::view_alloc(Kokkos::WithoutInitializing, labels[b]), chunk,
+          N, N);
+    auto instances = Kokkos::Experimental::partition_space(ExecSpace(), 1, 1);
+    gen_space = instances[0];
+    mul_space = instances[1];
+    fill_counter_random(x, Matvec<Scalar>::seed_x, int64_t(0),
+                        Matvec<Scalar>::init_bound(N));
+    Kokkos::fence();
+  }
+
+  int64_t footprint() const {
+    const int64_t buffers = nchunks > 1 ? 2 : 1;
+    return sizeof(Scalar) * (buffers * chunk * N * N + 2 * N * N);
+  }
+
+  int64_t chunk_size(int64_t c) const {
+    return c * chunk + chunk <= N ? chunk : N - c * chunk;
+  }
+
+  double flops() const { return 2. * N * N * N; }
+  double bytes() const {
+    return sizeof(Scalar) * (1. * N * N * N + 3. * N * N);
+  }
+
+  void generate_kokkos(int64_t c) {
+    fill_counter_random(gen_space, buf[c % 2].data(), chunk_size(c) * N * N,
+                        Matvec<Scalar>::seed_m, int64_t(0),
+                        Matvec<Scalar>::init_bound(N), c * chunk * N * N);
+  }
+
+  // Same team structure as Matvec::batched_matrix_vector_kokkos, one team
+  // per matrix of the chunk.
+  void multiply_kokkos(int64_t c) {
+    const int64_t first = c * chunk, n = N;
+    auto m = buf[c % 2];
+    auto x_ = x;
+    auto y_ = y;
+    team_policy policy(mul_space, chunk_size(c), launch_kk.team_size,
+                       launch_kk.vector_length);
+    Kokkos::parallel_for(
+        "stream_matvec", policy, KOKKOS_LAMBDA(const member_type &team) {
+          const int64_t b = team.league_rank();
+          const int64_t i = first + b;
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(team, n), [&](const int64_t j) {
+                const Scalar result =
+                    team_simd_row_dot(team, &m(b, j, 0), &x_(i, 0), n);
+                Kokkos::single(Kokkos::PerThread(team),
+                               [&]() { y_(i, j) += result; });
+              });
+        });
+  }
+
+  // Buffer c % 2 was last read by chunk c - 1, whose multiply is fenced
+  // before chunk c + 1 is generated into the other buffer.
+  void pass_kokkos() {
+    generate_kokkos(0);
+    for (int64_t c = 0; c < nchunks; ++c) {
+      gen_space.fence();
+      if (c + 1 < nchunks)
+        generate_kokkos(c + 1);
+      multiply_kokkos(c);
+      mul_space.fence();
+    }
+  }
+
+  // The OMPT pass issues every kernel as a deferred target task. deps[b]
+  // orders the generation into buffer b after the multiply that last read
+  // it and before the multiply that reads it next, so the generation of
+  // chunk c + 1 runs alongside the multiply of chunk c.
+  void pass_ompt() {
+    Scalar *bufs[2] = {buf[0].data(), buf[nchunks > 1 ? 1 : 0].data()};
+    Scalar *x_ptr = x.data();
+    Scalar *y_ptr = y.data();
+    const uint64_t seed = Matvec<Scalar>::seed_m;
+    const int64_t hi = Matvec<Scalar>::init_bound(N);
+    const int64_t n = N;
+    char deps[2];
+    for (int64_t c = 0; c < nchunks; ++c) {
+      Scalar *m_ptr = bufs[c % 2];
+      const int64_t first = c * chunk, nb = chunk_size(c);
+      const int64_t offset = first * n * n, end = offset + nb * n * n;
+#pragma omp target teams distribute parallel for is_device_ptr(m_ptr)        \
+    nowait depend(out : deps[c % 2])
+      for (int64_t blk = offset / 2; blk < (end + 1) / 2; ++blk) {
+        uint64_t r[2];
+        CounterRng(seed).block(blk, r[0], r[1]);
+        for (int h = 0; h < 2; ++h) {
+          const int64_t q = 2 * blk + h;
+          if (q >= offset && q < end)
+            m_ptr[q - offset] =
+                Scalar(CounterRng::to_range(r[h], int64_t(0), hi));
+        }
+      }
+
+#pragma omp target teams distribute is_device_ptr(m_ptr, x_ptr, y_ptr)       \
+    nowait depend(in : deps[c % 2])
+      for (int64_t b = 0; b < nb; ++b) {
+#pragma omp parallel for
+        for (int64_t j = 0; j < n; ++j)
+          y_ptr[(first + b) * n + j] +=
+              simd_row_dot(m_ptr + (b * n + j) * n, x_ptr + (first + b) * n, n);
+      }
+    }
+#pragma omp taskwait
+  }
+
+  // Seconds per pass after one warmup pass; y ends up as (R + 1) m x.
+  template <class Kernel> double time_pass(Kernel kernel, int R) {
+    Kokkos::deep_copy(y, Scalar(0));
+    return time_kernel(kernel, R);
+  }
+};
+
+// Streaming against all-resident batched matvec. The resident Matvec is
+// only built when its matrix fits in MATVEC_RESIDENT_BYTES; both versions
+// run the same number of passes, so their y have to be identical.
+template <class Scalar> void run_streaming_test(int64_t N, int R,
+                                                int64_t budget_bytes) {
+  using host_t = typename StreamingMatvec<Scalar>::vector_t::HostMirror;
+  if (StreamingMatvec<Scalar>::chunk_for_budget(N, budget_bytes) < 1) {
+    printf("StreamingMatvec: %s, N = %li, budget %li MB is below x, y and "
+           "two single-matrix buffers (%.1lf MB)\n",
+           matvec_type_name<Scalar>(), N, budget_bytes >> 20,
+           4. * N * N * sizeof(Scalar) / (1 << 20));
+    return;
+  }
+  StreamingMatvec<Scalar> stream(N, budget_bytes);
+  printf("StreamingMatvec: %s, N = %li, budget %li MB, %li chunks of %li, "
+         "footprint %li MB\n",
+         matvec_type_name<Scalar>(), N, budget_bytes >> 20, stream.nchunks,
+         stream.chunk, stream.footprint() >> 20);
+
+  const char *names[2] = {"OMPT", "KK"};
+  double t_stream[2];
+  host_t y_stream[2];
+  // Real copies: a mirror view of stream.y would alias it on host backends
+  // and the KK pass would overwrite the OMPT result.
+  for (int v = 0; v < 2; ++v) {
+    if (v == 0)
+      t_stream[v] = stream.time_pass([&]() { stream.pass_ompt(); }, R);
+    else
+      t_stream[v] = stream.time_pass([&]() { stream.pass_kokkos(); }, R);
+    y_stream[v] = Kokkos::create_mirror(Kokkos::HostSpace(), stream.y);
+    Kokkos::deep_copy(y_stream[v], stream.y);
+  }
+
+  const double matrix_bytes = 1. * N * N * N * sizeof(Scalar);
+  const bool resident = matrix_bytes <= MATVEC_RESIDENT_BYTES;
+  if (!resident)
+    printf("Resident matrix of %.0lf MB exceeds MATVEC_RESIDENT_BYTES, "
+           "streaming only\n",
+           matrix_bytes / (1 << 20));
+  std::unique_ptr<Matvec<Scalar>> full;
+  if (resident)
+    full.reset(new Matvec<Scalar>(N));
+  for (int v = 0; v < 2; ++v) {
+    printf("%s: stream %e s/pass %lf GFlop/s %lf GB/s", names[v], t_stream[v],
+           1e-9 * stream.flops() / t_stream[v],
+           1e-9 * stream.bytes() / t_stream[v]);
+    if (full == nullptr) {
+      printf("\n");
+      continue;
+    }
+    Kokkos::deep_copy(full->y, Scalar(0));
+    const double t_full =
+        v == 0
+            ? time_kernel([&]() { full->batched_matrix_vector_ompt(); }, R)
+            : time_kernel([&]() { full->batched_matrix_vector_kokkos(); }, R);
+    auto y_full =
+        Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), full->y);
+    int64_t errors = 0;
+    for (int64_t i = 0; i < N; ++i)
+      for (int64_t j = 0; j < N; ++j)
+        if (y_stream[v](i, j) != y_full(i, j))
+          ++errors;
+    printf(", resident %e s/pass %lf GFlop/s, stream/resident %.2lf "
+           "(%li errors)\n",
+           t_full, 1e-9 * full->flops() / t_full, t_stream[v] / t_full,
+           errors);
+  }
+}
+
+#endif